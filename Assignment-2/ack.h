@@ -0,0 +1,24 @@
+/* ACK-only packets, built the same way by the protocol engines */
+
+#define NOTINUSE (-1)   /* used to fill header fields that are not being used */
+#define ACKPAYLOAD 20   /* payload bytes of an ACK-only packet */
+
+/* a new ACK-only packet with one reference, acknowledging acknum, with
+   sequence number seqnum (NOTINUSE unless the receiver numbers its ACKs) */
+static inline struct pkt *makeack(struct pktpool *pool, const struct checksum *checksum,
+                                  int seqnum, int acknum)
+{
+  struct pkt *ackpkt = pktalloc(pool);
+
+  ackpkt->seqnum = seqnum;
+  ackpkt->acknum = acknum;
+
+  /* we don't have any data to send.  fill payload with 0's, as many as
+     the original fixed payload so that its corruption is still noticed */
+  ackpkt->length = ACKPAYLOAD;
+  memset(ackpkt->payload, '0', ACKPAYLOAD);
+
+  /* compute checksum */
+  ackpkt->checksum = ComputeChecksum(checksum, ackpkt);
+  return ackpkt;
+}
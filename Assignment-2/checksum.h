@@ -0,0 +1,23 @@
+/* a checksum algorithm, CHECKSUM_SUM, CHECKSUM_INET or CHECKSUM_CRC32C
+   (emulator.h).  The checksum covers the header and payload, but not the
+   checksum field itself */
+struct checksum {
+  const char *name;
+
+  /* the part of the checksum that covers the payload.  A sender can keep
+     it with a packet, and after changing the header recompute the
+     checksum with header() without going over the payload again */
+  unsigned int (*payload)(const char *payload, int length);
+  int (*header)(const struct pkt *, unsigned int);
+};
+
+/* the implementation of an algorithm, using the CPU's CRC32C
+   instruction when it has one */
+extern const struct checksum *getchecksum(int);
+
+/* checksum of a packet's header and payload, excluding the checksum field */
+extern int ComputeChecksum(const struct checksum *, const struct pkt *);
+
+/* true if the checksum stored in the packet does not match its contents,
+   or its length is out of range */
+extern bool IsCorrupted(const struct checksum *, const struct pkt *);
@@ -0,0 +1,79 @@
+/* ******************************************************************
+   Microbenchmark of the packet checksums.
+
+   Times ComputeChecksum() and IsCorrupted() of each algorithm over a set
+   of packets like the ones the protocols send, and prints the cost per
+   packet.  The payload size is the first argument, 20 by default.
+
+   Built by make checksumbench.
+   ********************************************************************* */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+#include "emulator.h"
+#include "checksum.h"
+
+#define  NPACKETS  64         /* distinct packets, small enough to stay in cache */
+#define  ROUNDS    50000      /* passes over the packets */
+
+static struct pkt packets[NPACKETS];
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* nanoseconds per packet to checksum, and to check, every packet */
+static void bench(int kind)
+{
+  const struct checksum *c = getchecksum(kind);
+  double start, compute, check;
+  int r, i, bad;
+
+  start = now();
+  for (r=0; r<ROUNDS; r++)
+    for (i=0; i<NPACKETS; i++)
+      packets[i].checksum = ComputeChecksum(c, &packets[i]);
+  compute = now() - start;
+
+  bad = 0;
+  start = now();
+  for (r=0; r<ROUNDS; r++)
+    for (i=0; i<NPACKETS; i++)
+      bad += IsCorrupted(c, &packets[i]);
+  check = now() - start;
+
+  printf("%-8s compute %6.2f ns  check %6.2f ns  per packet%s\n", c->name,
+         compute * 1e9 / ((double)ROUNDS * NPACKETS),
+         check * 1e9 / ((double)ROUNDS * NPACKETS),
+         bad != 0 ? "  (checksum mismatch!)" : "");
+}
+
+int main(int argc, char *argv[])
+{
+  int length = (argc > 1) ? atoi(argv[1]) : 20;
+  int i;
+
+  if (length < 0 || length > MAXPAYLOAD) {
+    printf("%s: payload size must be 0 to %d\n", argv[0], MAXPAYLOAD);
+    exit(EXIT_FAILURE);
+  }
+
+  /* the sequence numbers and payloads the emulator generates: a window of
+     sequence numbers, and the same letter repeated in each message */
+  for (i=0; i<NPACKETS; i++) {
+    packets[i].seqnum = i % 16;
+    packets[i].acknum = i % 7 == 0 ? i % 16 : -1;
+    packets[i].length = length;
+    memset(packets[i].payload, 'a' + i % 26, length);
+  }
+
+  bench(CHECKSUM_SUM);
+  bench(CHECKSUM_INET);
+  bench(CHECKSUM_CRC32C);
+  return 0;
+}
@@ -0,0 +1,76 @@
+#include <stdbool.h>
+#include "emulator.h"
+#include "cwnd.h"
+
+/* AIMD congestion control of the Go Back N sender, in the manner of TCP
+   Reno (RFC 5681) but counted in packets. */
+
+/* copy the window into the statistics of the run and the emulator's
+   congestion window log */
+static void publish(struct cwnd *c)
+{
+  if (c->report) {
+    c->stats->cwnd = c->cwnd;
+    c->stats->ssthresh = c->ssthresh;
+  }
+  logcwnd(c->emu, c->entity, c->cwnd, c->ssthresh);
+}
+
+void cwndinit(struct cwnd *c, struct emulator *emu, int entity, bool report)
+{
+  const struct params *params = getparams(emu);
+
+  c->emu = emu;
+  c->stats = getstats(emu);
+  c->report = report;
+  /* B only sends with bidirectional transfer */
+  c->enabled = params->congestion != 0 && (entity == A || params->bidirectional);
+  c->entity = entity;
+  c->maxwindow = params->windowsize;
+  c->cwnd = CWNDINITIAL;
+  c->ssthresh = params->windowsize;
+  if (c->enabled)
+    publish(c);
+}
+
+int cwndlimit(const struct cwnd *c)
+{
+  int limit = (int)c->cwnd;
+
+  if (!c->enabled || limit > c->maxwindow)
+    return c->maxwindow;
+  return limit < 1 ? 1 : limit;
+}
+
+void cwndacked(struct cwnd *c, int acked)
+{
+  double before = c->cwnd;
+  int i;
+
+  if (!c->enabled)
+    return;
+  for (i=0; i<acked && c->cwnd < c->maxwindow; i++) {
+    if (c->cwnd < c->ssthresh)
+      c->cwnd += 1.0;
+    else
+      c->cwnd += 1.0 / c->cwnd;
+  }
+  if (c->cwnd > c->maxwindow)
+    c->cwnd = c->maxwindow;
+  if (c->cwnd != before)
+    publish(c);
+}
+
+void cwndlost(struct cwnd *c, int outstanding, bool timeout)
+{
+  if (!c->enabled)
+    return;
+  c->stats->cwnd_cuts++;
+  c->ssthresh = outstanding / 2.0;
+  if (c->ssthresh < SSTHRESHMIN)
+    c->ssthresh = SSTHRESHMIN;
+  c->cwnd = timeout ? CWNDINITIAL : c->ssthresh;
+  if (c->cwnd > c->maxwindow)
+    c->cwnd = c->maxwindow;
+  publish(c);
+}
@@ -0,0 +1,35 @@
+/* congestion window of one Go Back N sender, which limits the packets it
+   has outstanding below the window while the network is congested.  It
+   grows by a packet per packet acknowledged in slow start, up to the slow
+   start threshold, then by a packet per window (additive increase).  A
+   loss halves the threshold (multiplicative decrease): a timeout starts
+   again from a window of one, a fast retransmit from the threshold.  The
+   window never grows past the sender window.  Without congestion control
+   the limit is always the sender window. */
+struct cwnd {
+  struct emulator *emu;    /* the network the sender runs over */
+  struct stats *stats;     /* statistics of the current run */
+  bool report;             /* copy the window into the statistics */
+  bool enabled;            /* limit the sender by the congestion window */
+  int entity;              /* A or B, the sender */
+  int maxwindow;           /* the sender window, the largest congestion window */
+  double cwnd;             /* congestion window, in packets */
+  double ssthresh;         /* slow start threshold */
+};
+
+#define CWNDINITIAL   1.0     /* congestion window at the start of a run */
+#define SSTHRESHMIN   2.0     /* smallest slow start threshold after a loss */
+
+/* every sender counts its window cuts in the statistics of the run, the
+   one initialised with report true also leaves its window there */
+extern void cwndinit(struct cwnd *, struct emulator *, int, bool);
+
+/* packets the sender may have outstanding */
+extern int cwndlimit(const struct cwnd *);
+
+/* a new ACK acknowledged this many packets */
+extern void cwndacked(struct cwnd *, int);
+
+/* a packet was lost with this many packets outstanding, detected by the
+   timer if the flag is true and by duplicate ACKs otherwise */
+extern void cwndlost(struct cwnd *, int, bool);
@@ -36,19 +36,22 @@
    ********************************************************************* */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
 #include "emulator.h"
+#include "trace.h"
+#include "rng.h"
+#include "rto.h"
+#include "cwnd.h"
+#include "msgqueue.h"
+#include "checksum.h"
+#include "pktpool.h"
+#include "ack.h"
+#include "evlog.h"
+#include "source.h"
 #include "gbn.h"
-
-struct event {
-  float evtime;           /* event time */
-  int evtype;             /* event type code */
-  int eventity;           /* entity where event occurs */
-  struct pkt *pktptr;     /* ptr to packet (if any) assoc w/ this event */
-  struct event *prev;
-  struct event *next;
-};
-
-struct event *evlist = NULL;   /* the event list */
+#include "sr.h"
 
 /* possible events: */
 #define  TIMER_INTERRUPT 0  
@@ -58,45 +61,151 @@ struct event *evlist = NULL;   /* the event list */
 #define  OFF             0
 #define  ON              1
 
-int TRACE = 3;
+struct event {
+  double evtime;          /* event time */
+  int evtype;             /* event type code */
+  int eventity;           /* entity where event occurs */
+  struct pkt *pkt;        /* reference to the packet (if any) assoc w/ this event */
+  unsigned long evseq;    /* insertion order, used to break ties on evtime */
+  int heapidx;            /* position of this event in evlist, -1 if not queued */
+  int conn;               /* connection the event belongs to, in the padding
+                             after heapidx to keep an event at 48 bytes */
+  struct event *chnext;   /* next packet in flight on the same channel, or
+                             next free event while on the freelist */
+};
+
+/* the medium in each direction, indexed by the receiving entity.  Packets
+   are never reordered, so the FROM_LAYER3 events in flight towards an
+   entity form a FIFO ordered by arrival time */
+struct channel {
+  struct event *head;     /* next packet to arrive */
+  struct event *tail;     /* packet with the latest scheduled arrival */
+  int inflight;           /* number of packets currently in the medium */
+  double busysince;       /* time the medium last went from empty to busy */
+};
+
+/* a FIFO of times, which grows by doubling */
+struct timering {
+  double *times;
+  int head;               /* index of the oldest time */
+  int count;
+  int mask;               /* ring capacity - 1, the capacity is a power of two */
+};
+
+#define  TIMERINGINITIAL 64   /* capacity of a ring of times when it first grows */
+
+/* the bottleneck link in each direction, indexed by the receiving entity,
+   which replaces the channel delays when params.linkrate is set.  Packets
+   wait in a FIFO while the link transmits the ones in front of them, take
+   the propagation delay to arrive, and are dropped when the queue is full
+   or, with RED, early at random as the average queue length grows */
+struct link {
+  struct timering departures;  /* times the packets held by the link finish transmission */
+  double lastdeparture;   /* time the link finishes transmitting every packet it holds */
+  double redavg;          /* RED average of the queue length */
+  int redcount;           /* packets since the last early drop, -1 below the RED band */
+};
+
+/* RED: weight of a new queue length in the average, the drop probability
+   at the upper threshold, and the thresholds as fractions of the buffer */
+#define  REDWEIGHT   0.002
+#define  REDMAXP     0.1
+#define  REDMINTH    0.25
+#define  REDMAXTH    0.75
+
+/* one sender/receiver pair.  Every connection has its own protocol state,
+   timers and messages in transit; all of them share the channels */
+struct conn {
+  struct gbn gbn;           /* protocol state of A and B, when running GBN */
+  struct sr sr;             /* protocol state of A and B, when running SR */
+  struct event *timers[2];  /* the running timer event of A and B, if any */
+  /* arrival times of the messages A or B accepted from layer 5 for the
+     other side and not delivered yet.  The protocols deliver them in the
+     order they were accepted, so the next one delivered is at the head */
+  struct timering arrivals[2];
+  bool offered[2];          /* a message of the saturating source is on the event
+                               list for A or B */
+};
+
+/* events are carved out of slabs and recycled through a freelist, so the
+   steady state of a run does no malloc/free at all */
+#define  EVSLAB       256     /* events allocated per slab */
+#define  EVRESERVEMAX 65536   /* upper bound on events reserved up front */
+
+struct evslab {
+  struct evslab *next;
+  struct event events[EVSLAB];
+};
 
-/* statistics updated by GBN */
-int window_full;   /* count of the number of messages dropped due to full window */
-int total_ACKs_received;
-int packets_resent;       /* count of the number of packets resent  */
-int new_ACKs;           /* count of the number of acks correctly received */
-int packets_received;  /* count of the packets received by receiver */
-
-/* statistics updated by emulator */
-static int packets_lost;  
-static int packets_corrupt;
-static int packets_sent;
-static int packets_timeout;
-static int messages_delivered;
-
-static int nsim = 0;              /* number of messages from 5 to 4 so far */ 
-static int nsimmax = 0;           /* number of msgs to generate, then stop */
-static float time = 0.000;
-static float lossprob;            /* probability that a packet is dropped  */
-static float corruptprob;   /* probability that one bit is packet is flipped */
-static int corruptdirection; /* A->B A<-B or bidirectional corruption/loss */
-static float lambda;        /* arrival rate of messages from layer 5 */   
-static int   ntolayer3;           /* number sent into layer 3 */
-static int   nlost;               /* number lost in media */
-static int ncorrupt;              /* number corrupted by media*/
+/* independent random number streams, one per source of randomness */
+#define  RNG_ARRIVAL   0      /* message inter-arrival times and senders */
+#define  RNG_LOSS      1      /* packet loss decisions */
+#define  RNG_CORRUPT   2      /* corruption decisions and what is corrupted */
+#define  RNG_DELAY     3      /* channel delays */
+#define  RNG_QUEUE     4      /* RED drop decisions of the links */
+#define  NRNGSTREAMS   5
+
+struct emulator {
+  struct params params;     /* parameters of the current run */
+  struct stats stats;       /* statistics of the current run */
+
+  /* the connections of the current run, indexed by connection ID */
+  struct conn *conns;
+  int nconns;               /* connections in the current run */
+  int connsize;             /* connections allocated, kept for the following runs */
+  struct conn *current;     /* connection of the event being handled */
+
+  /* the event list is a binary min-heap of event pointers ordered by evtime */
+  struct event **evlist;
+  int evcount;              /* number of events in the heap */
+  int evsize;               /* allocated slots in evlist */
+  unsigned long evseqnext;
+
+  struct channel channels[2];
+  struct link links[2];
+
+  struct evslab *evslabs;   /* every slab allocated so far */
+  struct event *evfree;     /* events available for reuse */
+  int evpoolsize;           /* events owned by the pool */
+
+  struct pktpool packets;   /* buffers of the packets in flight and held by the protocol */
+
+  const char *logpath;      /* event log every run is recorded to, or NULL */
+  struct evlogwriter log;   /* the log of the current run, if recording */
+  struct evlogreader *replay;  /* the log being replayed, NULL when simulating */
+  const char *cwndpath;     /* congestion window log of every run, or NULL */
+  FILE *cwndlog;            /* the congestion window log of the current run */
+
+  const char *sourcepath;   /* arrival trace of the runs with ARRIVAL_TRACE, or NULL */
+  struct sourcereader source;  /* the arrival trace of the current run, if any */
+  double sourcetime;        /* time of the next arrival in the trace */
+  const char *nextpayload;  /* its payload in the trace, and the payload's length */
+  int nextlength;
+  const char *payload;      /* payload of the arrival being dispatched, and its length */
+  int payloadlength;
+  double onuntil;           /* end of the current on period of ARRIVAL_ONOFF */
+  int running;              /* a run was started and has not finished */
+  struct steady steady;     /* batch means of the steady state, see params.precision */
+  int stopped;              /* the steady state estimates converged, the run ends */
+
+  struct rng streams[NRNGSTREAMS];
+
+  double time;
+  int nsim;                 /* number of messages from 5 to 4 so far */
+};
+
+int TRACE = 3;
 
 /****************************************************************************/
-/* jimsrand(): return a double in range [0,1].  The routine below is used to */
-/* isolate all random number generation in one location.  We assume that the*/
-/* system-supplied rand() function return an int in therange [0,mmm]        */
+/* jimsrand(): return a double in range [0,1).  The routine below is used to */
+/* isolate all random number generation in one location.  Every caller names */
+/* the stream it draws from, see rng.h                                      */
 /****************************************************************************/
-double jimsrand(void) 
+static double jimsrand(struct emulator *emu, int stream) 
 {
-  double mmm = RAND_MAX;     /* largest int  - MACHINE DEPENDENT!!!!!!!!   */
   double x;                   
-  x = rand()/mmm;            /* x should be uniform in [0,1] */
-  if (TRACE > 3)
-    printf("RANDOM NUMBER GENERAION CALLED: %f\n", x);
+  x = rnguniform(&emu->streams[stream]);   /* x is uniform in [0,1) */
+  TRACEF(4, "RANDOM NUMBER GENERAION CALLED: %f\n", x);
   return(x);
 }  
 
@@ -104,375 +213,1180 @@ double jimsrand(void)
 /*  The next set of routines handle the event list   */
 /*****************************************************/
 
-void insertevent(struct event *p)
+/* add one slab of events to the freelist */
+static void growevents(struct emulator *emu)
 {
-  struct event *q,*qold;
+  struct evslab *slab;
+  int i;
 
-  if (TRACE>2) {
-    printf("            INSERTEVENT: time is %f\n",time);
-    printf("            INSERTEVENT: future time will be %f\n",p->evtime); 
+  slab = malloc(sizeof(struct evslab));
+  if (slab == NULL) {
+    printf("memory allocation for event failed.");
+    exit(EXIT_FAILURE);
   }
-  q = evlist;     /* q points to front of list in which p struct inserted */
-  if (q==NULL) {   /* list is empty */
-    evlist=p;
-    p->next=NULL;
-    p->prev=NULL;
+  slab->next = emu->evslabs;
+  emu->evslabs = slab;
+  for (i=EVSLAB-1; i>=0; i--) {
+    slab->events[i].chnext = emu->evfree;
+    emu->evfree = &slab->events[i];
   }
-  else {
-    for (qold = q; q !=NULL && p->evtime > q->evtime; q=q->next)
-      qold=q; 
-    if (q==NULL) {   /* end of list */
-      qold->next = p;
-      p->prev = qold;
-      p->next = NULL;
-    }
-    else if (q==evlist) { /* front of list */
-      p->next=evlist;
-      p->prev=NULL;
-      p->next->prev=p;
-      evlist = p;
-    }
-    else {     /* middle of list */
-      p->next=q;
-      p->prev=q->prev;
-      q->prev->next=p;
-      q->prev=p;
+  emu->evpoolsize += EVSLAB;
+}
+
+/* make sure at least n events can be allocated without calling malloc */
+static void reserveevents(struct emulator *emu, long n)
+{
+  if (n > EVRESERVEMAX)
+    n = EVRESERVEMAX;
+  while (emu->evpoolsize < n)
+    growevents(emu);
+}
+
+static struct event *allocevent(struct emulator *emu)
+{
+  struct event *p;
+
+  if (emu->evfree == NULL)
+    growevents(emu);
+  p = emu->evfree;
+  emu->evfree = p->chnext;
+  p->heapidx = -1;
+  p->pkt = NULL;            /* only the arrivals from layer 3 carry a packet */
+  return p;
+}
+
+static void freeevent(struct emulator *emu, struct event *p)
+{
+  p->chnext = emu->evfree;
+  emu->evfree = p;
+}
+
+/* true if event p must be dispatched before event q.  Equal times are
+   broken by insertion order, newest first, which is the order the old
+   sorted linked list produced (it inserted ahead of equal-time events) */
+static int evbefore(const struct event *p, const struct event *q)
+{
+  if (p->evtime != q->evtime)
+    return (p->evtime < q->evtime);
+  return (p->evseq > q->evseq);
+}
+
+static void evplace(struct emulator *emu, struct event *p, int i)
+{
+  emu->evlist[i] = p;
+  p->heapidx = i;
+}
+
+static void evsiftup(struct emulator *emu, int i)
+{
+  struct event *p = emu->evlist[i];
+  int parent;
+
+  while (i > 0) {
+    parent = (i - 1) / 2;
+    if (!evbefore(p, emu->evlist[parent]))
+      break;
+    evplace(emu, emu->evlist[parent], i);
+    i = parent;
+  }
+  evplace(emu, p, i);
+}
+
+static void evsiftdown(struct emulator *emu, int i)
+{
+  struct event *p = emu->evlist[i];
+  int child;
+
+  while ((child = 2*i + 1) < emu->evcount) {
+    if (child + 1 < emu->evcount && evbefore(emu->evlist[child + 1], emu->evlist[child]))
+      child++;
+    if (!evbefore(emu->evlist[child], p))
+      break;
+    evplace(emu, emu->evlist[child], i);
+    i = child;
+  }
+  evplace(emu, p, i);
+}
+
+static void insertevent(struct emulator *emu, struct event *p)
+{
+  struct event **grown;
+
+  emu->stats.inserts++;
+  if (TRACING(3)) {
+    fprintf(tracefile, "            INSERTEVENT: time is %f\n",emu->time);
+    fprintf(tracefile, "            INSERTEVENT: future time will be %f\n",p->evtime); 
+  }
+  if (emu->evcount == emu->evsize) {
+    emu->evsize = (emu->evsize == 0) ? 64 : 2*emu->evsize;
+    grown = realloc(emu->evlist, emu->evsize * sizeof(struct event *));
+    if (grown == NULL) {
+      printf("memory allocation for event list failed.");
+      exit(EXIT_FAILURE);
     }
+    emu->evlist = grown;
+  }
+  p->evseq = emu->evseqnext++;
+  evplace(emu, p, emu->evcount++);
+  evsiftup(emu, p->heapidx);
+  INSTR(if (emu->evcount > emu->stats.instr.evlistmax)
+          emu->stats.instr.evlistmax = emu->evcount;)
+}
+
+/* unlink an event from anywhere in the event list */
+static void removeevent(struct emulator *emu, struct event *p)
+{
+  int i = p->heapidx;
+  struct event *last;
+
+  last = emu->evlist[--emu->evcount];
+  p->heapidx = -1;
+  if (i == emu->evcount)
+    return;
+  evplace(emu, last, i);
+  if (i > 0 && evbefore(last, emu->evlist[(i - 1) / 2]))
+    evsiftup(emu, i);
+  else
+    evsiftdown(emu, i);
+}
+
+/* restore heap order after the evtime of a queued event has changed.  The
+   event is given a fresh sequence number, so ties are broken as if it had
+   just been removed and inserted again */
+static void rescheduleevent(struct emulator *emu, struct event *p)
+{
+  int i = p->heapidx;
+
+  p->evseq = emu->evseqnext++;
+  if (i > 0 && evbefore(p, emu->evlist[(i - 1) / 2]))
+    evsiftup(emu, i);
+  else
+    evsiftdown(emu, i);
+}
+
+/* remove and return the earliest event, or NULL if the list is empty */
+static struct event *nextevent(struct emulator *emu)
+{
+  struct event *p;
+
+  if (emu->evcount == 0)
+    return NULL;
+  p = emu->evlist[0];
+  removeevent(emu, p);
+  return p;
+}
+
+/* exponentially distributed time with the given mean */
+static double exponential(struct emulator *emu, double mean)
+{
+  return -mean * log(1.0 - jimsrand(emu, RNG_ARRIVAL));
+}
+
+/* time from now to the next message of the on/off source.  Messages only
+   arrive in on periods, and since every period and gap between them is
+   exponential, the next message of a new on period is timed from its start */
+static double onoffinterval(struct emulator *emu)
+{
+  double t = emu->time + exponential(emu, emu->params.lambda);
+  double off;
+
+  while (t >= emu->onuntil) {
+    off = emu->onuntil + exponential(emu, emu->params.offtime);
+    emu->onuntil = off + exponential(emu, emu->params.ontime);
+    t = off + exponential(emu, emu->params.lambda);
   }
+  return t - emu->time;
+}
+
+/* the arrival from the trace due next becomes the one dispatched next,
+   and the following one is read; false at the end of the trace.  Only one
+   arrival from the trace is ever on the event list */
+static bool sourceadvance(struct emulator *emu)
+{
+  emu->payload = emu->nextpayload;
+  emu->payloadlength = emu->nextlength;
+  return sourcenext(&emu->source, &emu->sourcetime, &emu->nextpayload, &emu->nextlength);
 }
 
-void generate_next_arrival(void)
+static void generate_next_arrival(struct emulator *emu)
 {
   double x;
   struct event *evptr;
 
-  if (TRACE>2)
-    printf("          GENERATE NEXT ARRIVAL: creating new arrival\n");
- 
-  x = lambda*jimsrand()*2;  /* x is uniform on [0,2*lambda] */
-  /* having mean of lambda        */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
+  TRACEF(3, "          GENERATE NEXT ARRIVAL: creating new arrival\n");
+
+  if (emu->params.arrivals == ARRIVAL_SATURATE)
+    return;                     /* see refill() */
+  else if (emu->params.arrivals == ARRIVAL_POISSON)
+    x = exponential(emu, emu->params.lambda);
+  else if (emu->params.arrivals == ARRIVAL_ONOFF)
+    x = onoffinterval(emu);
+  else if (emu->params.arrivals == ARRIVAL_TRACE) {
+    if (!sourceadvance(emu))
+      return;
+    x = emu->sourcetime - emu->time;
   }
-  evptr->evtime =  time + x;
+  else
+    x = emu->params.lambda*jimsrand(emu, RNG_ARRIVAL)*2;  /* x is uniform on [0,2*lambda] */
+  /* having mean of lambda        */
+  evptr = allocevent(emu);
+  evptr->evtime =  emu->time + x;
   evptr->evtype =  FROM_LAYER5;
-  if (BIDIRECTIONAL && (jimsrand()>0.5) )
+  if (emu->params.bidirectional && (jimsrand(emu, RNG_ARRIVAL)>0.5) )
     evptr->eventity = B;
   else
     evptr->eventity = A;
-  insertevent(evptr);
+  evptr->conn = 0;
+  if (emu->nconns > 1)
+    evptr->conn = (int)(emu->nconns * jimsrand(emu, RNG_ARRIVAL));
+  insertevent(emu, evptr);
 } 
 
-void printevlist(void)
+static int evcompare(const void *a, const void *b)
+{
+  const struct event *p = *(struct event * const *)a;
+  const struct event *q = *(struct event * const *)b;
+
+  if (evbefore(p, q))
+    return -1;
+  return (evbefore(q, p));
+}
+
+void printevlist(struct emulator *emu)
 {
+  struct event **sorted;
   struct event *q;
+  int i;
+
   printf("--------------\nEvent List Follows:\n");
-  for(q = evlist; q!=NULL; q=q->next) {
-    printf("Event time: %f, type: %d entity: %d\n",q->evtime,q->evtype,q->eventity);
+  sorted = malloc((emu->evcount + 1) * sizeof(struct event *));
+  if (sorted == NULL) {
+    printf("memory allocation for event list failed.");
+    exit(EXIT_FAILURE);
   }
+  for (i=0; i<emu->evcount; i++)
+    sorted[i] = emu->evlist[i];
+  qsort(sorted, emu->evcount, sizeof(struct event *), evcompare);
+  for (i=0; i<emu->evcount; i++) {
+    q = sorted[i];
+    printf("Event time: %f, type: %d entity: %d connection: %d\n",q->evtime,q->evtype,
+           q->eventity,q->conn);
+  }
+  free(sorted);
   printf("--------------\n");
 }
 
-void init(void)                         /* initialize the simulator */
+struct emulator *newemulator(void)
 {
-  float sum, avg;
+  struct emulator *emu;
+
+  emu = calloc(1, sizeof(struct emulator));
+  if (emu == NULL) {
+    printf("memory allocation for emulator failed.");
+    exit(EXIT_FAILURE);
+  }
+  return emu;
+}
+
+static void abandon(struct emulator *);
+
+void freeemulator(struct emulator *emu)
+{
+  struct evslab *slab;
   int i;
 
-  printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
-  printf("Enter the number of messages to simulate: ");
-  scanf("%d",&nsimmax);
-  printf("Enter  packet loss probability [enter 0.0 for no loss]:");
-  scanf("%f",&lossprob);
-  printf("Enter packet corruption probability [0.0 for no corruption]:");
-  scanf("%f",&corruptprob);
-  if (lossprob != 0.0 || corruptprob != 0.0) {
-    printf("If you want loss or corruption to only occur in one direction, choose the direction: 0 A->B, 1 A<-B, 2 A<->B (both directions) :");
-    scanf("%d",&corruptdirection);
-  }
-  printf("Enter average time between messages from sender's layer5 [ > 0.0]:");
-  scanf("%f",&lambda);
-  printf("Enter TRACE:");
-  scanf("%d",&TRACE);
-
-
-  srand(9999);              /* init random number generator */
-  sum = 0.0;                /* test random number generator for students */
-  for (i=0; i<1000; i++)
-    sum+=jimsrand();    /* jimsrand() should be uniform in [0,1] */
-  avg = sum/1000.0;
-  if (avg < 0.25 || avg > 0.75) {
-    printf("It is likely that random number generation on your machine\n" ); 
-    printf("is different from what this emulator expects.  Please take\n");
-    printf("a look at the routine jimsrand() in the emulator code. Sorry. \n");
+  abandon(emu);
+  while ((slab = emu->evslabs) != NULL) {
+    emu->evslabs = slab->next;
+    free(slab);
+  }
+  free(emu->evlist);
+  for (i=0; i<emu->connsize; i++) {
+    free(emu->conns[i].arrivals[A].times);
+    free(emu->conns[i].arrivals[B].times);
+    freegbn(&emu->conns[i].gbn);
+    freesr(&emu->conns[i].sr);
+  }
+  free(emu->conns);
+  free(emu->links[A].departures.times);
+  free(emu->links[B].departures.times);
+  pktpoolfree(&emu->packets);
+  free(emu);
+}
+
+const struct params *getparams(struct emulator *emu)
+{
+  return &emu->params;
+}
+
+struct stats *getstats(struct emulator *emu)
+{
+  return &emu->stats;
+}
+
+struct pktpool *getpktpool(struct emulator *emu)
+{
+  return &emu->packets;
+}
+
+double gettime(struct emulator *emu)
+{
+  return emu->time;
+}
+
+/* make room for the connections of a run.  Connections are kept for the
+   following runs, with the buffers their protocol state has allocated */
+static void growconns(struct emulator *emu, int n)
+{
+  struct conn *grown;
+
+  if (n <= emu->connsize)
+    return;
+  grown = realloc(emu->conns, n * sizeof(struct conn));
+  if (grown == NULL) {
+    printf("memory allocation for connections failed.");
     exit(EXIT_FAILURE);
   }
+  memset(grown + emu->connsize, 0, (n - emu->connsize) * sizeof(struct conn));
+  emu->conns = grown;
+  emu->connsize = n;
+}
+
+static void init(struct emulator *emu, const struct params *params)   /* initialize the simulator */
+{
+  struct conn *c;
+  int senders, i;
+
+  emu->params = *params;
+  rngseedstreams(emu->streams, NRNGSTREAMS, params->seed);   /* init random number generator */
 
   /* initialise statistics */
-  window_full = 0;
-  total_ACKs_received = 0;
-  packets_resent = 0;
-  new_ACKs = 0;
-  packets_received = 0;
-  packets_lost = 0;  
-  packets_corrupt = 0;
-  packets_sent = 0;
-  packets_timeout = 0;
-  messages_delivered = 0;
+  memset(&emu->stats, 0, sizeof(emu->stats));
+  emu->nsim = 0;
+
+  /* what can be outstanding at once: a window of data packets and as many
+     ACKs for each end that sends, the timers of A and B and a saturating
+     source's offers on each connection, and the next arrival.  Go back
+     resends still in flight beside their originals grow the pool later */
+  senders = params->bidirectional ? 2 : 1;
+  reserveevents(emu, params->connections * (senders * 2L * params->windowsize + 4) + 1);
+
+  /* a previous run always ends with the event list drained, so only the
+     bookkeeping that refers to it has to be reset */
+  emu->evseqnext = 0;
+  memset(emu->channels, 0, sizeof(emu->channels));
+  for (i=A; i<=B; i++) {
+    emu->links[i].departures.head = emu->links[i].departures.count = 0;
+    emu->links[i].lastdeparture = 0.0;
+    emu->links[i].redavg = 0.0;
+    emu->links[i].redcount = -1;
+  }
+  growconns(emu, params->connections);
+  emu->nconns = params->connections;
+  for (i=0; i<emu->nconns; i++) {
+    c = &emu->conns[i];
+    c->timers[A] = c->timers[B] = NULL;
+    c->arrivals[A].head = c->arrivals[A].count = 0;
+    c->arrivals[B].head = c->arrivals[B].count = 0;
+    c->offered[A] = c->offered[B] = false;
+  }
+  emu->current = &emu->conns[0];
+
+  /* a replay only needs the trace for the payloads of the messages */
+  if (params->arrivals == ARRIVAL_TRACE && (emu->replay == NULL || params->sourcepayload)) {
+    if (emu->sourcepath == NULL) {
+      printf("a run with arrivals from a trace needs an arrival trace\n");
+      exit(EXIT_FAILURE);
+    }
+    sourceopen(&emu->source, emu->sourcepath);
+    emu->nextlength = 0;
+  }
+  if (params->arrivals == ARRIVAL_ONOFF)
+    emu->onuntil = exponential(emu, params->ontime);
 
-  ntolayer3 = 0;
-  nlost = 0;
-  ncorrupt = 0;
+  /* packets the protocol still held at the end of the last run.  The
+     buffers hold the messages' payloads and an ACK's; payloads from a
+     trace, and those of a log, can be as long as MAXPAYLOAD */
+  if ((params->arrivals == ARRIVAL_TRACE && params->sourcepayload) || emu->replay != NULL)
+    pktpoolreset(&emu->packets, MAXPAYLOAD);
+  else
+    pktpoolreset(&emu->packets, params->payloadsize > ACKPAYLOAD ? params->payloadsize
+                                                                : ACKPAYLOAD);
 
-  time=0.0;                    /* initialize time to 0.0 */
-  generate_next_arrival();     /* initialize event list */
+  emu->time=0.0;                    /* initialize time to 0.0 */
+  steadyinit(&emu->steady, emu->time);
+  emu->stopped = 0;
+  if (emu->replay == NULL)
+    generate_next_arrival(emu);     /* initialize event list */
 }
 
 /********************** Student-callable ROUTINES ***********************/
 
 /* called by students routine to cancel a previously-started timer */
-void stoptimer(int AorB)
+void stoptimer(struct emulator *emu, int AorB)
 /* A or B is trying to stop timer */
 {
   struct event *q;
 
-  if (TRACE>1)
-    printf("          STOP TIMER: stopping timer at %f\n",time);
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-  for (q=evlist; q!=NULL ; q = q->next) 
-    if ( (q->evtype==TIMER_INTERRUPT  && q->eventity==AorB) ) { 
-      /* remove this event */
-      if (q->next==NULL && q->prev==NULL)
-        evlist=NULL;         /* remove first and only event on list */
-      else if (q->next==NULL) /* end of list - there is one in front */
-        q->prev->next = NULL;
-      else if (q==evlist) { /* front of list - there must be event after */
-        q->next->prev=NULL;
-        evlist = q->next;
-      }
-      else {     /* middle of list */
-        q->next->prev = q->prev;
-        q->prev->next =  q->next;
-      }
-      free(q);
-      return;
-    }
-  printf("Warning: unable to cancel your timer. It wasn't running.\n");
+  TRACEF(2, "          STOP TIMER: stopping timer at %f\n",emu->time);
+  q = emu->current->timers[AorB];
+  if (q == NULL) {
+    printf("Warning: unable to cancel your timer. It wasn't running.\n");
+    INSTR(emu->stats.instr.notrunning++;)
+    return;
+  }
+  INSTR(emu->stats.instr.timerstops++;)
+  /* remove this event */
+  removeevent(emu, q);
+  freeevent(emu, q);
+  emu->current->timers[AorB] = NULL;
 }
 
 
-void starttimer(int AorB, double increment)
+void starttimer(struct emulator *emu, int AorB, double increment)
 /* A or B is trying to start timer */
 {
-
-  struct event *q;
   struct event *evptr;
 
-  if (TRACE>1)
-    printf("          START TIMER: starting timer at %f\n",time);
+  TRACEF(2, "          START TIMER: starting timer at %f\n",emu->time);
   /* be nice: check to see if timer is already started, if so, then  warn */
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-  for (q=evlist; q!=NULL ; q = q->next)  
-    if ( (q->evtype==TIMER_INTERRUPT  && q->eventity==AorB) ) { 
-      printf("Warning: attempt to start a timer that is already started\n");
-      return;
-    }
+  if (emu->current->timers[AorB] != NULL) {
+    printf("Warning: attempt to start a timer that is already started\n");
+    INSTR(emu->stats.instr.alreadystarted++;)
+    return;
+  }
+  INSTR(emu->stats.instr.timerstarts++;)
  
   /* create future event for when timer goes off */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
-  evptr->evtime =  time + increment;
+  evptr = allocevent(emu);
+  evptr->evtime =  emu->time + increment;
   evptr->evtype =  TIMER_INTERRUPT;
-   
- 
   evptr->eventity = AorB;
-  insertevent(evptr);
+  evptr->conn = emu->current - emu->conns;
+  insertevent(emu, evptr);
+  emu->current->timers[AorB] = evptr;
 } 
 
+/* move a running timer to expire increment time units from now, or start
+   it if it is not running.  Equivalent to stoptimer() + starttimer() but
+   the timer event is rescheduled in place */
+void restarttimer(struct emulator *emu, int AorB, double increment)
+{
+  struct event *q;
+
+  q = emu->current->timers[AorB];
+  if (q == NULL) {
+    starttimer(emu, AorB, increment);
+    return;
+  }
+  TRACEF(2, "          RESTART TIMER: restarting timer at %f\n",emu->time);
+  INSTR(emu->stats.instr.timerrestarts++;)
+  q->evtime = emu->time + increment;
+  rescheduleevent(emu, q);
+}
+
+
+/* number of packets sent by A or B that are still in the medium */
+int intransit(struct emulator *emu, int AorB)
+{
+  return emu->channels[(AorB+1) % 2].inflight;
+}
+
+static void channelpush(struct emulator *emu, struct event *p)
+{
+  struct channel *ch = &emu->channels[p->eventity];
+
+  p->chnext = NULL;
+  if (ch->inflight == 0)
+    ch->busysince = emu->time;   /* unused when a link counts its transmission time */
+  if (ch->tail == NULL)
+    ch->head = p;
+  else
+    ch->tail->chnext = p;
+  ch->tail = p;
+  ch->inflight++;
+}
+
+static void channelpop(struct emulator *emu, struct event *p)
+{
+  struct channel *ch = &emu->channels[p->eventity];
+
+  if (ch->head != p) {
+    printf("INTERNAL PANIC: packet delivered out of order \n");
+    exit(EXIT_FAILURE);
+  }
+  ch->head = p->chnext;
+  if (ch->head == NULL)
+    ch->tail = NULL;
+  ch->inflight--;
+  if (ch->inflight == 0 && emu->params.linkrate == 0.0)
+    emu->stats.channelbusy[p->eventity] += emu->time - ch->busysince;
+}
+
+/* append a time to a ring */
+static void timepush(struct timering *q, double t)
+{
+  double *grown;
+  int capacity, i;
+
+  if (q->times == NULL || q->count > q->mask) {
+    capacity = (q->times == NULL) ? TIMERINGINITIAL : 2 * (q->mask + 1);
+    grown = malloc(capacity * sizeof(double));
+    if (grown == NULL) {
+      printf("memory allocation for times failed.");
+      exit(EXIT_FAILURE);
+    }
+    for (i=0; i<q->count; i++)
+      grown[i] = q->times[(q->head + i) & q->mask];
+    free(q->times);
+    q->times = grown;
+    q->head = 0;
+    q->mask = capacity - 1;
+  }
+  q->times[(q->head + q->count) & q->mask] = t;
+  q->count++;
+}
+
+/* remove the oldest time of a ring, which must not be empty */
+static void timepop(struct timering *q)
+{
+  q->head = (q->head + 1) & q->mask;
+  q->count--;
+}
+
+/* remember the arrival of a message that A or B accepted for the other side */
+static void pusharrival(struct emulator *emu, int towards, double t)
+{
+  timepush(&emu->current->arrivals[towards], t);
+}
+
+/* time the link takes to transmit a packet with length bytes of payload */
+static double linktxtime(struct emulator *emu, int length)
+{
+  if (emu->params.linkbytes)
+    return (offsetof(struct pkt, payload) + length) / emu->params.linkrate;
+  return 1.0 / emu->params.linkrate;
+}
+
+/* RED: decide whether a packet arriving at a link is dropped early, from
+   the average queue length.  tx is the time the link takes to send it */
+static bool earlydrop(struct emulator *emu, struct link *l, double tx)
+{
+  double minth = REDMINTH * emu->params.linkbuffer;
+  double maxth = REDMAXTH * emu->params.linkbuffer;
+  double pb, pa;
+
+  if (l->departures.count > 0)
+    l->redavg = (1 - REDWEIGHT) * l->redavg + REDWEIGHT * l->departures.count;
+  else   /* age the average by the packets the idle link could have sent */
+    l->redavg *= pow(1 - REDWEIGHT, (emu->time - l->lastdeparture) / tx);
+
+  if (l->redavg < minth) {
+    l->redcount = -1;
+    return false;
+  }
+  if (l->redavg >= 2 * maxth) {
+    l->redcount = 0;
+    return true;
+  }
+  /* the drop probability rises to REDMAXP at the upper threshold, and
+     on to 1 at twice that ("gentle" RED), spread out evenly in between */
+  if (l->redavg < maxth)
+    pb = REDMAXP * (l->redavg - minth) / (maxth - minth);
+  else
+    pb = REDMAXP + (1 - REDMAXP) * (l->redavg - maxth) / maxth;
+  l->redcount++;
+  pa = (l->redcount * pb < 1.0) ? pb / (1.0 - l->redcount * pb) : 1.0;
+  if (jimsrand(emu, RNG_QUEUE) < pa) {
+    l->redcount = 0;
+    return true;
+  }
+  return false;
+}
+
+/* queue a packet at the link towards an entity.  Returns 0 and the time
+   the packet has been transmitted in departure, or EVLOG_QUEUEDROP or
+   EVLOG_EARLYDROP if the queue drops it */
+static int linkenqueue(struct emulator *emu, int towards, const struct pkt *packet,
+                       double *departure)
+{
+  struct link *l = &emu->links[towards];
+  struct timering *q = &l->departures;
+  double tx = linktxtime(emu, packet->length);
+
+  /* the packets transmitted by now have left the queue */
+  while (q->count > 0 && q->times[q->head] <= emu->time)
+    timepop(q);
+
+  if (emu->params.red && earlydrop(emu, l, tx)) {
+    emu->stats.nearlydrop++;
+    return EVLOG_EARLYDROP;
+  }
+  if (emu->params.linkbuffer != QUEUEUNBOUNDED && q->count >= emu->params.linkbuffer) {
+    emu->stats.nqueuedrop++;
+    return EVLOG_QUEUEDROP;
+  }
+  if (l->lastdeparture < emu->time)
+    l->lastdeparture = emu->time;
+  l->lastdeparture += tx;
+  timepush(q, l->lastdeparture);
+  emu->stats.channelbusy[towards] += tx;
+  *departure = l->lastdeparture;
+  return 0;
+}
+
+/* check a packet sent while replaying against the one in the log */
+static void replaysend(struct emulator *emu, int AorB, const struct pkt *packet)
+{
+  struct channel *ch = &emu->channels[(AorB+1) % 2];
+  struct evrecord rec;
+
+  if (evlogpeek(emu->replay) != EVLOG_SEND) {
+    TRACEF(1, "          TOLAYER3: packet was not sent in the log\n");
+    emu->stats.replay_mismatches++;
+    return;
+  }
+  evlognext(emu->replay, &rec, NULL);
+  if (rec.entity != AorB || rec.conn != emu->current - emu->conns ||
+      rec.seqnum != packet->seqnum || rec.acknum != packet->acknum ||
+      rec.checksum != packet->checksum || rec.length != packet->length) {
+    TRACEF(1, "          TOLAYER3: packet differs from the log\n");
+    emu->stats.replay_mismatches++;
+  }
+  if (rec.flags & EVLOG_QUEUEDROP) {
+    emu->stats.nqueuedrop++;
+    return;
+  }
+  if (rec.flags & EVLOG_EARLYDROP) {
+    emu->stats.nearlydrop++;
+    return;
+  }
+  if (emu->params.linkrate > 0.0)
+    emu->stats.channelbusy[(AorB+1) % 2] += linktxtime(emu, rec.length);
+  if (rec.flags & EVLOG_LOST)
+    emu->stats.nlost++;
+  else if (ch->inflight++ == 0)
+    ch->busysince = emu->time;   /* the medium only counts the packets in flight */
+  if (rec.flags & EVLOG_CORRUPT)
+    emu->stats.ncorrupt++;
+}
 
 /************************** TOLAYER3 ***************/
-void tolayer3(int AorB, struct pkt packet)
+void tolayer3(struct emulator *emu, int AorB, struct pkt *packet)
 /* A or B is sending to network  */
 {
   struct pkt *mypktptr;
   struct event *evptr,*q;
-  float lastime, x;
-  int i;
+  double lastime, departure = 0.0, x;
+  int dropped;
+
+  emu->stats.ntolayer3++;
 
-  ntolayer3++;
+  /* the log has the packets that arrive and what happened to this one */
+  if (emu->replay != NULL) {
+    replaysend(emu, AorB, packet);
+    return;
+  }
+
+  /* the packet waits for the link, unless its queue is full */
+  if (emu->params.linkrate > 0.0 &&
+      (dropped = linkenqueue(emu, (AorB+1) % 2, packet, &departure)) != 0) {
+    TRACEF(1, "          TOLAYER3: packet dropped by the link queue\n");
+    if (emu->logpath != NULL)
+      evlogsend(&emu->log, emu->time, AorB, emu->current - emu->conns, packet, dropped);
+    return;
+  }
 
   /* simulate losses: */
-  if (jimsrand() < lossprob && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
-    nlost++;
-    if (TRACE>0)    
-      printf("          TOLAYER3: packet being lost\n");
+  if (jimsrand(emu, RNG_LOSS) < emu->params.lossprob && (!(AorB == B && emu->params.corruptdirection == A) && !(AorB == A && emu->params.corruptdirection == B))) {
+    emu->stats.nlost++;
+    TRACEF(1, "          TOLAYER3: packet being lost\n");
+    if (emu->logpath != NULL)
+      evlogsend(&emu->log, emu->time, AorB, emu->current - emu->conns, packet, EVLOG_LOST);
     return;
   }  
 
-  /* make a copy of the packet student just gave me since he/she may decide */
-  /* to do something with the packet after we return back to him/her */ 
-  mypktptr = malloc(sizeof(struct pkt));
-  if (mypktptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
-  mypktptr->seqnum = packet.seqnum;
-  mypktptr->acknum = packet.acknum;
-  mypktptr->checksum = packet.checksum;
-  for (i=0; i<20; i++)
-    mypktptr->payload[i] = packet.payload[i];
-  if (TRACE>2)  {
-    printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
-           mypktptr->acknum,  mypktptr->checksum);
-    for (i=0; i<20; i++)
-      printf("%c",mypktptr->payload[i]);
-    printf("\n");
-  }
-
-  /* create future event for arrival of packet at the other side */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
+  /* create future event for arrival of packet at the other side, holding */
+  /* a reference to the packet student just gave me.  He/she may decide  */
+  /* to change the packet after we return back to him/her, but only after */
+  /* unsharing it, so the packet in flight stays the same                 */
+  evptr = allocevent(emu);
+  mypktptr = evptr->pkt = pkthold(packet);
+  if (TRACING(3))
+    fprintf(tracefile, "          TOLAYER3: seq: %d, ack %d, check: %d %.*s\n", mypktptr->seqnum,
+            mypktptr->acknum,  mypktptr->checksum, mypktptr->length, mypktptr->payload);
+
   evptr->evtype =  FROM_LAYER3;   /* packet will pop out from layer3 */
   evptr->eventity = (AorB+1) % 2; /* event occurs at other entity */
-  evptr->pktptr = mypktptr;       /* save ptr to my copy of packet */
+  evptr->conn = emu->current - emu->conns;
   /* finally, compute the arrival time of packet at the other end.
      medium can not reorder, so make sure packet arrives between 1 and 10
      time units after the latest arrival time of packets
-     currently in the medium on their way to the destination */
-  lastime = time;
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next) */
-  for (q=evlist; q!=NULL ; q = q->next) 
-    if ( (q->evtype==FROM_LAYER3  && q->eventity==evptr->eventity) ) 
-      lastime = q->evtime;
-  evptr->evtime =  lastime + 1 + 9*jimsrand();
+     currently in the medium on their way to the destination.  A link
+     delivers the packet once it is transmitted and has propagated */
+  if (emu->params.linkrate > 0.0)
+    evptr->evtime = departure + emu->params.propdelay;
+  else {
+    q = emu->channels[evptr->eventity].tail;
+    lastime = (q != NULL) ? q->evtime : emu->time;
+    evptr->evtime =  lastime + 1 + 9*jimsrand(emu, RNG_DELAY);
+  }
  
 
 
   /* simulate corruption: */
-  if ((jimsrand() < corruptprob)  && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
-    ncorrupt++;
-    if ( (x = jimsrand()) < .75)
-      mypktptr->payload[0]='Z';   /* corrupt payload */
+  if ((jimsrand(emu, RNG_CORRUPT) < emu->params.corruptprob)  && (!(AorB == B && emu->params.corruptdirection == A) && !(AorB == A && emu->params.corruptdirection == B))) {
+    emu->stats.ncorrupt++;
+    mypktptr = evptr->pkt = pktunshare(&emu->packets, mypktptr);   /* corrupt a copy */
+    if ( (x = jimsrand(emu, RNG_CORRUPT)) < .75)
+      /* corrupt payload; a trace payload may start with 'Z' already */
+      mypktptr->payload[0] = (mypktptr->payload[0] != 'Z') ? 'Z' : 'z';
     else if (x < .875)
       mypktptr->seqnum = 999999;
     else
       mypktptr->acknum = 999999;
-    if (TRACE>0)    
-      printf("          TOLAYER3: packet being corrupted\n");
+    TRACEF(1, "          TOLAYER3: packet being corrupted\n");
   }  
 
-  if (TRACE>2)  
-    printf("          TOLAYER3: scheduling arrival on other side\n");
-  insertevent(evptr);
+  if (emu->logpath != NULL)
+    evlogsend(&emu->log, emu->time, AorB, evptr->conn, packet,
+              mypktptr != packet ? EVLOG_CORRUPT : 0);
+  TRACEF(3, "          TOLAYER3: scheduling arrival on other side\n");
+  insertevent(emu, evptr);
+  channelpush(emu, evptr);
 } 
 
-void tolayer5(int AorB, char datasent[20])
+void tolayer5(struct emulator *emu, int AorB, const char *datasent, int length)
 {
-  int i;  
-  if (TRACE>2) {
-    printf("          TOLAYER5: data received by application at ");
+  struct timering *q;
+  double latency;
+
+  if (TRACING(3)) {
+    fprintf(tracefile, "          TOLAYER5: data received by application at ");
     if (AorB == A) 
-      printf("A: ");
+      fprintf(tracefile, "A: ");
     else
-      printf("B: ");
-    for (i=0; i<20; i++)  
-      printf("%c",datasent[i]);
-    printf("\n");
+      fprintf(tracefile, "B: ");
+    fprintf(tracefile, "%.*s\n", length, datasent);
+  }
+  emu->stats.messages_delivered++;
+
+  /* end to end latency, from the arrival of the message at layer 5 */
+  q = &emu->current->arrivals[AorB];
+  if (q->count > 0) {
+    latency = emu->time - q->times[q->head];
+    histadd(&emu->stats.latency, latency);
+    timepop(q);
+
+    /* the run stops at the end of this event once the estimates of the
+       steady state are precise enough */
+    if (emu->params.precision > 0.0 && steadyadd(&emu->steady, emu->time, latency)) {
+      steadyestimate(&emu->steady, &emu->stats.steady);
+      if (steadyconverged(&emu->stats.steady, emu->params.precision)) {
+        TRACEF(2, "          TOLAYER5: steady state estimates converged\n");
+        emu->stats.steady_converged = 1;
+        emu->stopped = 1;
+      }
+    }
   }
-  messages_delivered++;
 }
 
-int main(void)
+/********************** PROTOCOL DISPATCH ***********************/
+/* pass events to the protocol engine selected for the run         */
+/*****************************************************************/
+
+static void protoinit(struct emulator *emu)
 {
-  struct event *eventptr;
-  struct msg  msg2give;
-  struct pkt  pkt2give;
-   
-  int i,j;
-  
-  init();
-  A_init();
-  B_init();
-   
-  while (1) {
-    eventptr = evlist;            /* get next event to simulate */
-    if (eventptr==NULL)
-      goto terminate;
-    evlist = evlist->next;        /* remove this event from event list */
-    if (evlist!=NULL)
-      evlist->prev=NULL;
-    if (TRACE>=2) {
-      printf("\nEVENT time: %f,",eventptr->evtime);
-      printf("  type: %d",eventptr->evtype);
-      if (eventptr->evtype==0)
-        printf(", timerinterrupt  ");
-      else if (eventptr->evtype==1)
-        printf(", fromlayer5 ");
-      else
-        printf(", fromlayer3 ");
-      printf(" entity: %d\n",eventptr->eventity);
+  int i;
+
+  for (i=0; i<emu->nconns; i++) {
+    emu->current = &emu->conns[i];
+    if (emu->params.protocol == PROTO_SR) {
+      SR_A_init(&emu->current->sr, emu);
+      SR_B_init(&emu->current->sr, emu);
+    }
+    else {
+      A_init(&emu->current->gbn, emu);
+      B_init(&emu->current->gbn, emu);
     }
-    time = eventptr->evtime;        /* update time to next event time */
-    if (eventptr->evtype == FROM_LAYER5 ) {
-      if (nsim < nsimmax) {
-        generate_next_arrival();   /* set up future arrival */
-        /* fill in msg to give with string of same letter */    
-        j = nsim % 26; 
-        for (i=0; i<20; i++)  
-          msg2give.data[i] = 97 + j;
-        if (TRACE>2) {
-          printf("          MAINLOOP: data given to student: ");
-          for (i=0; i<20; i++) 
-            printf("%c", msg2give.data[i]);
-          printf("\n");
-        }
-        nsim++;
-        if (eventptr->eventity == A) 
-          A_output(msg2give);  
-        else
-          B_output(msg2give);  
+  }
+}
+
+static void protooutput(struct emulator *emu, int AorB, const struct msg *message)
+{
+  if (emu->params.protocol == PROTO_SR)
+    SR_A_output(&emu->current->sr, message);   /* sr only sends from A to B */
+  else if (AorB == A)
+    A_output(&emu->current->gbn, message);
+  else
+    B_output(&emu->current->gbn, message);
+}
+
+static void protoinput(struct emulator *emu, int AorB, struct pkt *packet)
+{
+  if (emu->params.protocol == PROTO_SR) {
+    if (AorB == A)
+      SR_A_input(&emu->current->sr, packet);
+    else
+      SR_B_input(&emu->current->sr, packet);
+  }
+  else if (AorB == A)
+    A_input(&emu->current->gbn, packet);
+  else
+    B_input(&emu->current->gbn, packet);
+}
+
+static void prototimer(struct emulator *emu, int AorB)
+{
+  if (emu->params.protocol == PROTO_SR)
+    SR_A_timerinterrupt(&emu->current->sr);   /* only A runs a timer */
+  else if (AorB == A)
+    A_timerinterrupt(&emu->current->gbn);
+  else
+    B_timerinterrupt(&emu->current->gbn);
+}
+
+static bool protoready(struct emulator *emu, int AorB)
+{
+  if (emu->params.protocol == PROTO_SR)
+    return AorB == A && SR_A_ready(&emu->current->sr);
+  else if (AorB == A)
+    return A_ready(&emu->current->gbn);
+  else
+    return B_ready(&emu->current->gbn);
+}
+
+#ifdef INSTRUMENT
+/* count a call of the protocol callback of AorB for an event type, which
+   started at cycle start */
+static void instrcallback(struct emulator *emu, int AorB, int evtype, unsigned long long start)
+{
+  emu->stats.instr.calls[AorB][evtype]++;
+  emu->stats.instr.cycles[AorB][evtype] += cyclecount() - start;
+}
+#endif
+
+static void traceevent(struct emulator *emu, double evtime, int evtype, int eventity, int conn)
+{
+  if (TRACING(2)) {
+    fprintf(tracefile, "\nEVENT time: %f,",evtime);
+    fprintf(tracefile, "  type: %d",evtype);
+    if (evtype==0)
+      fprintf(tracefile, ", timerinterrupt  ");
+    else if (evtype==1)
+      fprintf(tracefile, ", fromlayer5 ");
+    else
+      fprintf(tracefile, ", fromlayer3 ");
+    fprintf(tracefile, " entity: %d",eventity);
+    if (emu->nconns > 1)
+      fprintf(tracefile, " connection: %d",conn);
+    fprintf(tracefile, "\n");
+  }
+}
+
+/* hand an event at the current time to the protocol of a connection,
+   packet is the packet delivered by a FROM_LAYER3 event */
+static void dispatch(struct emulator *emu, int evtype, int eventity, int conn, struct pkt *packet)
+{
+  struct msg  msg2give;
+  int dropped;
+  int j;
+  INSTR(unsigned long long start;)
+
+  emu->stats.events++;
+  emu->current = &emu->conns[conn];
+  INSTR(if (evtype >= 0 && evtype < NEVTYPES)
+          emu->stats.instr.dispatched[evtype]++;
+        emu->stats.instr.evlistsum += emu->evcount;)
+  if (evtype == FROM_LAYER5 ) {
+    if (emu->nsim < emu->params.nsimmax) {
+      if (emu->params.arrivals == ARRIVAL_TRACE && emu->params.sourcepayload &&
+          emu->payloadlength > 0) {
+        /* the payload of the message in the trace */
+        msg2give.length = emu->payloadlength;
+        memcpy(msg2give.data, emu->payload, msg2give.length);
+      }
+      else {
+        /* fill in msg to give with string of same letter */
+        j = emu->nsim % 26;
+        msg2give.length = emu->params.payloadsize;
+        memset(msg2give.data, 97 + j, msg2give.length);
       }
-      else if (TRACE > 2)
-          printf("          FROM_LAYER5: no more messages to send: \n");
+      if (TRACING(3))
+        fprintf(tracefile, "          MAINLOOP: data given to student: %.*s\n",
+                msg2give.length, msg2give.data);
+      emu->nsim++;
+      dropped = emu->stats.window_full;
+      INSTR(start = cyclecount();)
+      protooutput(emu, eventity, &msg2give);
+      INSTR(instrcallback(emu, eventity, FROM_LAYER5, start);)
+      if (emu->stats.window_full == dropped)
+        pusharrival(emu, (eventity + 1) % 2, emu->time);
     }
-    else if (eventptr->evtype ==  FROM_LAYER3) {
-      pkt2give.seqnum = eventptr->pktptr->seqnum;
-      pkt2give.acknum = eventptr->pktptr->acknum;
-      pkt2give.checksum = eventptr->pktptr->checksum;
-      for (i=0; i<20; i++)  
-        pkt2give.payload[i] = eventptr->pktptr->payload[i];
-	    if (eventptr->eventity ==A)      /* deliver packet by calling */
-        A_input(pkt2give);            /* appropriate entity */
-      else
-        B_input(pkt2give);
-	    free(eventptr->pktptr);          /* free the memory for packet */
+    else
+      TRACEF(3, "          FROM_LAYER5: no more messages to send: \n");
+  }
+  else if (evtype ==  FROM_LAYER3) {
+    INSTR(start = cyclecount();)
+    protoinput(emu, eventity, packet);   /* deliver packet to the appropriate entity */
+    INSTR(instrcallback(emu, eventity, FROM_LAYER3, start);)
+  }
+  else if (evtype ==  TIMER_INTERRUPT) {
+    INSTR(start = cyclecount();)
+    prototimer(emu, eventity);
+    INSTR(instrcallback(emu, eventity, TIMER_INTERRUPT, start);)
+  }
+  else  {
+    printf("INTERNAL PANIC: unknown event type \n");
+  }
+}
+
+/* open the congestion window log of a run, if there is to be one */
+static void opencwndlog(struct emulator *emu)
+{
+  if (emu->cwndpath == NULL)
+    return;
+  if ((emu->cwndlog = fopen(emu->cwndpath, "w")) == NULL) {
+    printf("unable to open congestion window log %s\n", emu->cwndpath);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(emu->cwndlog, "# time connection entity cwnd ssthresh\n");
+}
+
+static void closecwndlog(struct emulator *emu)
+{
+  if (emu->cwndlog == NULL)
+    return;
+  if (fclose(emu->cwndlog) != 0) {
+    printf("unable to write congestion window log\n");
+    exit(EXIT_FAILURE);
+  }
+  emu->cwndlog = NULL;
+}
+
+void logcwnd(struct emulator *emu, int AorB, double cwnd, double ssthresh)
+{
+  if (emu->cwndlog != NULL)
+    fprintf(emu->cwndlog, "%f %d %c %f %f\n", emu->time, (int)(emu->current - emu->conns),
+            'A' + AorB, cwnd, ssthresh);
+}
+
+/* the saturating source offers A, and B with bidirectional transfer, a
+   message of a connection whenever its sender has room in the window.
+   Each offer is an event at the current time, so that it is dispatched,
+   and recorded, like any other message from layer 5 */
+static void refill(struct emulator *emu, int conn)
+{
+  struct conn *c = &emu->conns[conn];
+  struct event *evptr;
+  int i;
+
+  emu->current = c;
+  for (i=A; i<=(emu->params.bidirectional ? B : A); i++) {
+    if (c->offered[i] || emu->nsim >= emu->params.nsimmax || !protoready(emu, i))
+      continue;
+    evptr = allocevent(emu);
+    evptr->evtime = emu->time;
+    evptr->evtype = FROM_LAYER5;
+    evptr->eventity = i;
+    evptr->conn = conn;
+    insertevent(emu, evptr);
+    c->offered[i] = true;
+  }
+}
+
+/* the arrival trace of a run, if it has one, is done with */
+static void closesource(struct emulator *emu)
+{
+  if (emu->source.map == NULL)
+    return;
+  sourceunmap(&emu->source);
+}
+
+/* empty the event list of a run that ends before it drains */
+static void dropevents(struct emulator *emu)
+{
+  struct event *q;
+
+  while ((q = nextevent(emu)) != NULL) {
+    if (q->evtype == FROM_LAYER3)
+      pktrelease(&emu->packets, q->pkt);
+    freeevent(emu, q);
+  }
+}
+
+/* drop a run that was started but not finished, e.g. after it was
+   branched in forked processes: its events, and the logs it wrote */
+static void abandon(struct emulator *emu)
+{
+  if (!emu->running)
+    return;
+  dropevents(emu);
+  if (emu->log.buf != NULL)
+    evlogclose(&emu->log);
+  closecwndlog(emu);
+  closesource(emu);
+  emu->running = 0;
+}
+
+/* start a run: the protocol is initialised and the first events are
+   on the event list */
+void startemulator(struct emulator *emu, const struct params *params)
+{
+  int i;
+
+  abandon(emu);
+  init(emu, params);
+  opencwndlog(emu);
+  protoinit(emu);
+  if (emu->logpath != NULL)
+    evlogcreate(&emu->log, emu->logpath, params);
+  if (params->arrivals == ARRIVAL_SATURATE)
+    for (i=0; i<emu->nconns; i++)
+      refill(emu, i);
+  emu->running = 1;
+}
+
+/* dispatch the events up to time until */
+void advanceemulator(struct emulator *emu, double until)
+{
+  struct event *eventptr;
+
+  while (!emu->stopped && emu->evcount > 0 && emu->evlist[0]->evtime <= until) {
+    eventptr = nextevent(emu);   /* get and remove next event */
+    traceevent(emu, eventptr->evtime, eventptr->evtype, eventptr->eventity, eventptr->conn);
+    emu->time = eventptr->evtime;        /* update time to next event time */
+    if (eventptr->evtype == FROM_LAYER5 && emu->nsim < emu->params.nsimmax)
+      generate_next_arrival(emu);   /* set up future arrival */
+    else if (eventptr->evtype ==  FROM_LAYER3)
+      channelpop(emu, eventptr);
+    else if (eventptr->evtype ==  TIMER_INTERRUPT)
+      emu->conns[eventptr->conn].timers[eventptr->eventity] = NULL;   /* timer has expired */
+    if (emu->logpath != NULL)
+      evlogevent(&emu->log, emu->time, eventptr->evtype, eventptr->eventity, eventptr->conn,
+                 eventptr->pkt);
+    dispatch(emu, eventptr->evtype, eventptr->eventity, eventptr->conn, eventptr->pkt);
+    if (emu->params.arrivals == ARRIVAL_SATURATE) {
+      if (eventptr->evtype == FROM_LAYER5)
+        emu->conns[eventptr->conn].offered[eventptr->eventity] = false;
+      refill(emu, eventptr->conn);
     }
-    else if (eventptr->evtype ==  TIMER_INTERRUPT) {
-      if (eventptr->eventity == A) 
-        A_timerinterrupt();
-      else
-        B_timerinterrupt();
+    if (eventptr->evtype ==  FROM_LAYER3)
+      pktrelease(&emu->packets, eventptr->pkt);
+    freeevent(emu, eventptr);
+  }
+}
+
+/* simulate until the event list drains, or the steady state estimates
+   converge */
+void finishemulator(struct emulator *emu, struct stats *stats)
+{
+  advanceemulator(emu, HUGE_VAL);
+  dropevents(emu);
+  if (emu->params.precision > 0.0)
+    steadyestimate(&emu->steady, &emu->stats.steady);
+  if (emu->logpath != NULL)
+    evlogclose(&emu->log);
+  closecwndlog(emu);
+  closesource(emu);
+  emu->running = 0;
+  emu->stats.time = emu->time;
+  emu->stats.nsim = emu->nsim;
+  *stats = emu->stats;
+}
+
+void runemulator(struct emulator *emu, const struct params *params, struct stats *stats)
+{
+  startemulator(emu, params);
+  finishemulator(emu, stats);
+}
+
+void branchemulator(struct emulator *emu, float lossprob, float corruptprob)
+{
+  emu->params.lossprob = lossprob;
+  emu->params.corruptprob = corruptprob;
+}
+
+void recordemulator(struct emulator *emu, const char *path)
+{
+  emu->logpath = path;
+}
+
+void sourceemulator(struct emulator *emu, const char *path)
+{
+  emu->sourcepath = path;
+}
+
+void cwndlogemulator(struct emulator *emu, const char *path)
+{
+  emu->cwndpath = path;
+}
+
+/* feed the events of a log to the protocol until the log ends */
+void replayemulator(struct emulator *emu, const char *path, struct params *params, struct stats *stats)
+{
+  struct evlogreader log;
+  struct evrecord rec;
+  struct event *q;
+  struct event **timer;
+  struct channel *ch;
+  struct pkt *packet;
+  int i;
+
+  abandon(emu);
+  evlogopen(&log, path);
+  *params = log.params;
+  emu->replay = &log;
+  init(emu, params);
+  opencwndlog(emu);
+  protoinit(emu);
+  if (emu->source.map != NULL)
+    sourceadvance(emu);
+
+  while (evlogpeek(&log) >= 0) {
+    packet = NULL;
+    if (evlogpeek(&log) == EVLOG_LAYER3)
+      packet = pktalloc(&emu->packets);
+    evlognext(&log, &rec, packet);
+
+    /* a packet the protocol no longer sends */
+    if (rec.type == EVLOG_SEND) {
+      emu->stats.replay_mismatches++;
+      continue;
     }
-    else  {
-      printf("INTERNAL PANIC: unknown event type \n");
+    traceevent(emu, rec.time, rec.type, rec.entity, rec.conn);
+    emu->time = rec.time;
+    ch = &emu->channels[rec.entity];
+    if (rec.type == FROM_LAYER3 && ch->inflight > 0 && --ch->inflight == 0 &&
+        emu->params.linkrate == 0.0)
+      emu->stats.channelbusy[rec.entity] += emu->time - ch->busysince;
+    timer = &emu->conns[rec.conn].timers[rec.entity];
+    if (rec.type == TIMER_INTERRUPT && (q = *timer) != NULL) {
+      /* the timer expires now, whatever the protocol set it to */
+      removeevent(emu, q);
+      freeevent(emu, q);
+      *timer = NULL;
     }
-    free(eventptr);
-  }
-
- terminate:
-  printf(" Simulator terminated at time %f\n after attempting to send %d msgs from layer5\n",time,nsim);
-  printf("number of messages dropped due to full window:  %d \n", window_full);
-  printf("number of valid (not corrupt or duplicate) acknowledgements received at A:  %d \n", new_ACKs);
-  printf("(note: a single acknowledgement may have acknowledged more than one packet - if cumulative acknowledgements are used)\n");
-  printf("number of packet resends by A:  %d \n", packets_resent);
-  printf("number of correct packets received at B:  %d \n", packets_received);
-  printf("number of messages delivered to application:  %d \n", messages_delivered);
-  return EXIT_SUCCESS;
-}
\ No newline at end of file
+    if (rec.type == FROM_LAYER5 && emu->source.map != NULL && emu->nsim < emu->params.nsimmax)
+      sourceadvance(emu);
+    dispatch(emu, rec.type, rec.entity, rec.conn, packet);
+    if (packet != NULL)
+      pktrelease(&emu->packets, packet);
+  }
+
+  /* the heap only holds the timers still running */
+  while ((q = nextevent(emu)) != NULL)
+    freeevent(emu, q);
+  for (i=0; i<emu->nconns; i++)
+    emu->conns[i].timers[A] = emu->conns[i].timers[B] = NULL;
+  evlogunmap(&log);
+  emu->replay = NULL;
+  closecwndlog(emu);
+  closesource(emu);
+  if (emu->params.precision > 0.0)
+    steadyestimate(&emu->steady, &emu->stats.steady);
+
+  emu->stats.time = emu->time;
+  emu->stats.nsim = emu->nsim;
+  *stats = emu->stats;
+}
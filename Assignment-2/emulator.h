@@ -1,20 +1,28 @@
-extern int TRACE;
+#include <stddef.h>
+#include <string.h>
+#include "histogram.h"
+#include "instrument.h"
+#include "steady.h"
 
-/* statistics updated by GBN */
-extern int total_ACKs_received;
-extern int packets_resent;       /* count of the number of packets resent  */
-extern int new_ACKs;      /* count of the number of acks correctly received */
-extern int packets_received;  /* count of the packets received by receiver */
-extern int window_full; /* count of the number of messages dropped due to full window */
+extern int TRACE;          /* trace level, shared by every emulator instance */
 
 #define   A    0
 #define   B    1
 
+/* largest payload of a packet, the Ethernet TCP MSS by default.  The
+   payload of each message is params.payloadsize bytes, which is 20 in
+   the original emulator; e.g. cc -DMAXPAYLOAD=20 for the original packet
+   layout */
+#ifndef MAXPAYLOAD
+#define MAXPAYLOAD 1460
+#endif
+
 /* a "msg" is the data unit passed from layer 5 (teachers code) to layer  */
 /* 4 (students' code).  It contains the data (characters) to be delivered */
 /* to layer 5 via the students transport level protocol entities.         */
 struct msg {
-  char data[20];
+  int length;              /* bytes of data used */
+  char data[MAXPAYLOAD];
 };
 
 /* a packet is the data unit passed from layer 4 (students code) to layer */
@@ -24,17 +32,231 @@ struct pkt {
   int seqnum;
   int acknum;
   int checksum;
-  char payload[20];
+  int length;              /* bytes of payload used */
+  char payload[MAXPAYLOAD];
+};
+
+/* copy a packet, only as far as its payload is used */
+static inline void copypkt(struct pkt *to, const struct pkt *from)
+{
+  memcpy(to, from, offsetof(struct pkt, payload) + from->length);
+}
+
+/* an emulator holds all the state of one simulation: the event list, the
+   clock, the channels, the random number streams and the protocol state
+   of each connection.  Independent emulators can run in parallel on
+   different threads. */
+struct emulator;
+
+/* parameters of one simulation run */
+struct params {
+  int nsimmax;             /* number of msgs to generate, then stop */
+  float lossprob;          /* probability that a packet is dropped  */
+  float corruptprob;       /* probability that one bit is packet is flipped */
+  int corruptdirection;    /* A->B A<-B or bidirectional corruption/loss */
+  float lambda;            /* arrival rate of messages from layer 5 */
+  unsigned int seed;       /* seed for the random number generator */
+  int windowsize;          /* the maximum number of buffered unacked packets */
+  int seqspace;            /* number of sequence numbers, 0 for the protocol's minimum */
+  double rtt;              /* round trip time used for the retransmission timer */
+  int adaptiverto;         /* 1 to estimate the timeout from the measured round trip time */
+  int dupthreshold;        /* duplicate ACKs that trigger a fast retransmit, 0 never */
+  int queuelimit;          /* messages held while the window is full, 0 drops them */
+  int ackevery;            /* in order packets B acknowledges together, 1 for every packet */
+  double ackdelay;         /* longest time B holds back an ACK */
+  int bidirectional;       /* 1 if messages arrive at B for A too */
+  int protocol;            /* protocol engine to run, PROTO_GBN or PROTO_SR */
+  int checksum;            /* packet checksum, CHECKSUM_SUM, CHECKSUM_INET or CHECKSUM_CRC32C */
+  int payloadsize;         /* bytes of data in each message, 1 to MAXPAYLOAD */
+  int connections;         /* sender/receiver pairs sharing the network, at least 1 */
+
+  /* the bottleneck link in each direction, instead of the original 1 to
+     10 time units of delay behind the last packet in the medium */
+  double linkrate;         /* packets, or bytes, the link sends per time unit, 0 for no link */
+  int linkbytes;           /* 1 if linkrate counts bytes: the header and the payload */
+  double propdelay;        /* time a packet takes to reach the far end once transmitted */
+  int linkbuffer;          /* packets held by the link, including the one being transmitted */
+  int red;                 /* 1 to drop early with Random Early Detection */
+
+  int congestion;          /* 1 to limit the gbn sender by an AIMD congestion window */
+
+  /* where the messages from layer 5 come from */
+  int arrivals;            /* arrival process, one of the ARRIVAL_* below */
+  double ontime;           /* mean length of the on periods of ARRIVAL_ONOFF */
+  double offtime;          /* mean length of its off periods */
+  int sourcepayload;       /* 1 to take the payloads of ARRIVAL_TRACE from the trace */
+
+  double precision;        /* stop once the 95% confidence intervals of the steady
+                              state goodput and latency are within this fraction of
+                              their means (steady.h), 0 to run every message */
+};
+
+/* queuelimit that holds every message until the window has room, and
+   linkbuffer of a link that never drops */
+#define QUEUEUNBOUNDED (-1)
+
+/* largest seqspace.  Corruption writes 999999 over a sequence or ACK
+   number, which the sum checksum only detects while the numbers are
+   smaller (checksum.c) */
+#define MAXSEQSPACE 999998
+
+/* largest seqspace with the Internet checksum, which is taken modulo
+   65535 and so cannot tell 999999 from 16974 */
+#define INETMAXSEQSPACE 16974
+
+/* arrival processes of the messages from layer 5, lambda apart on average */
+#define ARRIVAL_UNIFORM   0   /* uniform on [0, 2 lambda], the original emulator */
+#define ARRIVAL_POISSON   1   /* exponential times between the messages */
+#define ARRIVAL_ONOFF     2   /* Poisson in on periods, silent in off periods, each of
+                                 exponentially distributed length */
+#define ARRIVAL_SATURATE  3   /* a message whenever the sender has room in its window */
+#define ARRIVAL_TRACE     4   /* the times, and optionally payloads, of a trace (source.h) */
+
+/* protocol engines */
+#define PROTO_GBN  0          /* Go Back N, gbn.c */
+#define PROTO_SR   1          /* Selective Repeat, sr.c */
+
+/* engine used unless the run selects one, e.g. cc -DPROTO_DEFAULT=PROTO_SR */
+#ifndef PROTO_DEFAULT
+#define PROTO_DEFAULT PROTO_GBN
+#endif
+
+/* packet checksums, checksum.c */
+#define CHECKSUM_SUM    0     /* sum of the header fields and payload chars */
+#define CHECKSUM_INET   1     /* 16 bit one's complement sum, RFC 1071 */
+#define CHECKSUM_CRC32C 2     /* CRC32C, in hardware where the CPU has it */
+
+/* checksum used unless the run selects one */
+#ifndef CHECKSUM_DEFAULT
+#define CHECKSUM_DEFAULT CHECKSUM_SUM
+#endif
+
+/* statistics of one simulation run */
+struct stats {
+  /* updated by the protocol */
+  int total_ACKs_received;
+  int packets_sent;        /* count of the data packets sent for the first time */
+  int packets_resent;      /* count of the number of packets resent  */
+  int fast_retransmits;    /* count of the retransmissions triggered by duplicate ACKs */
+  int new_ACKs;            /* count of the number of acks correctly received */
+  int packets_received;    /* count of the packets received by receiver */
+  int acks_suppressed;     /* count of the ACKs B did not send because they were delayed */
+  int acks_sent;           /* count of the ACK-only packets sent */
+  int acks_piggybacked;    /* count of the ACKs carried by data packets instead */
+  int window_full;         /* count of the number of messages dropped due to full window */
+  int messages_queued;     /* count of the messages that waited for room in the window */
+  struct histogram queuedelay;  /* time from arrival at A to first transmission */
+  int timeouts;            /* number of retransmission timeouts at A */
+  int spurious_timeouts;   /* timeouts that resent a packet which was not lost */
+  int rtt_samples;         /* round trips measured, from packets sent only once */
+  double srtt;             /* final smoothed round trip time */
+  double rttvar;           /* final round trip time variation */
+  double rto;              /* final retransmission timeout estimate */
+  int cwnd_cuts;           /* losses that cut the congestion window */
+  double cwnd;             /* final congestion window at A */
+  double ssthresh;         /* final slow start threshold at A */
+
+  /* updated by emulator */
+  double time;             /* simulated time when the run ended */
+  int nsim;                /* number of messages from 5 to 4 */
+  int ntolayer3;           /* number sent into layer 3 */
+  int nlost;               /* number lost in media */
+  int ncorrupt;            /* number corrupted by media*/
+  int nqueuedrop;          /* number dropped by a full link queue */
+  int nearlydrop;          /* number dropped early by RED */
+  int messages_delivered;  /* number delivered to layer 5 */
+  struct histogram latency;  /* time from arrival at layer 5 to delivery at the other side */
+  double channelbusy[2];   /* time the medium towards A or B held at least one packet,
+                              or its link spent transmitting */
+  int replay_mismatches;   /* packets sent that differ from the replayed log */
+  int steady_converged;    /* 1 if the run stopped early with the precision reached */
+  struct steadyestimate steady;  /* the steady state estimates, with params.precision set */
+  long events;             /* number of events dispatched */
+  long inserts;            /* number of events put on the event list */
+
+  struct instrument instr;  /* kept only when built with -DINSTRUMENT, see instrument.h */
 };
 
-/* send to A or B (int), packet to send */
-extern void tolayer3(int, struct pkt);  
+/* parameters and statistics of the run an emulator is executing */
+extern const struct params *getparams(struct emulator *);
+extern struct stats *getstats(struct emulator *);
+
+/* pool of the packet buffers, see pktpool.h */
+extern struct pktpool *getpktpool(struct emulator *);
+
+/* current simulated time */
+extern double gettime(struct emulator *);
 
-/* deliver to A or B (int), data to deliver */
-extern void tolayer5(int, char[20]); 
+/* the routines below act for the connection whose event the protocol is
+   handling: its timers, and the packets and messages sent on it.  Every
+   connection has its own A and B, and all of them share the medium */
+
+/* send to A or B (int), packet to send.  The packet comes from the pool of
+   the emulator (pktpool.h); the emulator takes its own reference, and the
+   far side is handed the same buffer */
+extern void tolayer3(struct emulator *, int, struct pkt *);
+
+/* number of packets sent by A or B (int) still in the medium */
+extern int intransit(struct emulator *, int);
+
+/* deliver to A or B (int), data to deliver and its length */
+extern void tolayer5(struct emulator *, int, const char *, int);
 
 /* start timer at A or B (int), increment */
-extern void starttimer(int, double);       
+extern void starttimer(struct emulator *, int, double);
 
 /* stop timer at A or B (int) */
-extern void stoptimer(int);               
+extern void stoptimer(struct emulator *, int);
+
+/* restart a running timer at A or B (int), increment; starts it if stopped */
+extern void restarttimer(struct emulator *, int, double);
+
+/* the congestion window of A or B (int) changed to cwnd, with slow start
+   threshold ssthresh (double, double); written to the congestion window
+   log, if there is one */
+extern void logcwnd(struct emulator *, int, double, double);
+
+/* create an emulator, run one simulation on it to completion filling in
+   its statistics, and free it again.  An emulator can be reused for any
+   number of runs, one at a time */
+extern struct emulator *newemulator(void);
+extern void runemulator(struct emulator *, const struct params *, struct stats *);
+extern void freeemulator(struct emulator *);
+
+/* a run can also be taken in steps: started, advanced to a simulated
+   time, any number of times, and finished, which runs it to completion
+   and fills in its statistics as runemulator() does.  Starting another
+   run, or freeing the emulator, abandons a run that was not finished */
+extern void startemulator(struct emulator *, const struct params *);
+extern void advanceemulator(struct emulator *, double);
+extern void finishemulator(struct emulator *, struct stats *);
+
+/* change the loss and corruption probabilities (float, float) of a run in
+   progress.  A run advanced through a warm-up and then forked leaves each
+   child process with a snapshot of the whole emulator: the event list,
+   clock, random number streams and protocol state, which the child can
+   branch from with loss and corruption of its own */
+extern void branchemulator(struct emulator *, float, float);
+
+/* record the events of every following run of an emulator to a binary
+   event log (evlog.h) at path, NULL to stop recording */
+extern void recordemulator(struct emulator *, const char *);
+
+/* take the messages of every following run with ARRIVAL_TRACE from the
+   arrival trace at path (source.h), and the payloads of a replay of such
+   a run with params.sourcepayload set; NULL to stop */
+extern void sourceemulator(struct emulator *, const char *);
+
+/* write every change of a congestion window in every following run of an
+   emulator to a text file at path, a line of the time, connection, entity,
+   window and slow start threshold each; NULL to stop */
+extern void cwndlogemulator(struct emulator *, const char *);
+
+/* run the protocol on the events of the log at path instead of the
+   channel model, with the parameters of the recorded run, which are
+   returned in params.  Each packet the protocol sends is checked against
+   the log; those that differ count as replay mismatches */
+extern void replayemulator(struct emulator *, const char *, struct params *, struct stats *);
+
+/* default of params.bidirectional */
+#define BIDIRECTIONAL 0       /*  0 = A->B  1 =  A<->B */
@@ -0,0 +1,452 @@
+/* ******************************************************************
+   Benchmark of the emulator's event loop.
+
+   Runs a fixed set of scenarios at TRACE 0: no loss, 10% loss and 30%
+   corruption, each with a small window over the original channel and a
+   large window over a link of one packet per time unit.  The channel
+   model has no capacity, so a large window over it collapses into
+   retransmissions that deliver almost nothing; the link's queue keeps
+   the large window busy while the messages still get through.  Every
+   scenario runs in a child process of its own, so that its peak resident
+   set size can be told apart from the others'.  It is run to measure the
+   CPU and wall time and the events dispatched per second, along with the
+   events inserted and the packets sent per event dispatched.
+
+   Two loops on the scenario's parameters then time the event list and
+   tolayer3() on their own, in bulk: a read of the clock costs several
+   times an insertevent(), so timing each call would measure the clock.
+   The first starts and stops a timer TIMERCALLS times over a heap that
+   holds a window of packets in flight, an insert and a removal each; the
+   second sends SENDBATCH packets into a fresh run at a time.  Every
+   measurement is repeated for at least MINCPU, and the scenario is run
+   in PROCESSES children; the fastest of all of them counts, to keep out
+   the noise of the rest of the machine.
+
+   The results are printed as a table, which can be written to a baseline
+   file with -o and compared against one with -c.  The event and delivery
+   counts must match the baseline exactly, since the scenarios are
+   deterministic; ns/event, ns/timer or ns/send growing by more than the
+   threshold (-t, 20% by default) or the peak RSS by more than 8% and
+   256 KB is reported as a regression, and either makes the exit status
+   1.  The speed of a shared machine drifts by 15-20% over minutes, which
+   even the fastest of many runs does not hide, hence the threshold; a
+   quieter machine can take a tighter one.
+
+   Usage: emulatorbench [-n messages] [-o baseline] [-c baseline] [-t percent]
+
+   Built by make emulatorbench; make bench compares against
+   emulatorbench.baseline.
+   ********************************************************************* */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "emulator.h"
+#include "pktpool.h"
+
+#define  MESSAGES   50000     /* messages per run, unless -n is given */
+#define  REPEATS    5         /* runs of each kind, of which the fastest counts */
+#define  PROCESSES  3         /* processes each scenario runs in, of which the fastest counts */
+#define  MINCPU     0.5       /* CPU seconds the untimed runs are repeated for at least */
+#define  THRESHOLD  20.0      /* percent a cost may grow over the baseline */
+#define  RSSTHRESHOLD 8.0     /* percent the peak RSS may grow, which varies far less */
+#define  RSSSLACK   256       /* KB the peak RSS may grow by regardless, as a process's
+                                 own RSS varies by about 100 KB from run to run */
+#define  TIMERCALLS (1 << 20) /* timer starts and stops timed together */
+#define  SENDBATCH  1024      /* packets sent into one run, timed together */
+
+FILE *tracefile;              /* trace sink, see trace.h; nothing is traced */
+
+/* the fixed scenarios, on top of the parameters in scenarioparams() */
+struct scenario {
+  const char *name;
+  float lossprob;
+  float corruptprob;
+  int windowsize;
+  double linkrate;         /* packets per time unit of the link, 0 for the channel */
+};
+
+static const struct scenario scenarios[] = {
+  { "noloss-w8",          0.0, 0.0,  8, 0.0 },
+  { "noloss-w64-link",    0.0, 0.0, 64, 1.0 },
+  { "loss10-w8",          0.1, 0.0,  8, 0.0 },
+  { "loss10-w64-link",    0.1, 0.0, 64, 1.0 },
+  { "corrupt30-w8",       0.0, 0.3,  8, 0.0 },
+  { "corrupt30-w64-link", 0.0, 0.3, 64, 1.0 },
+};
+
+#define  NSCENARIOS  (int)(sizeof(scenarios) / sizeof(scenarios[0]))
+
+/* what one scenario measured, one line of the table and the baseline */
+struct result {
+  char name[32];
+  long events;             /* events dispatched */
+  long delivered;          /* messages delivered to layer 5 */
+  double wall;             /* wall seconds of the run */
+  double cpu;              /* CPU seconds of the run */
+  double eventrate;        /* events dispatched per CPU second */
+  double eventns;          /* CPU nanoseconds per event */
+  double inserts;          /* events inserted per event dispatched */
+  double sends;            /* tolayer3() calls per event dispatched */
+  double timerns;          /* nanoseconds per timer start and stop */
+  double sendns;           /* nanoseconds per tolayer3() */
+  long rsskb;              /* peak resident set size of the child, in KB */
+};
+
+static double walltime(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* CPU time of the process, which leaves out the time the machine gives to
+   other work; in wall time that adds up to half again to a scenario */
+static double cputime(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void scenarioparams(const struct scenario *s, int messages, struct params *p)
+{
+  memset(p, 0, sizeof(*p));
+  p->nsimmax = messages;
+  p->lossprob = s->lossprob;
+  p->corruptprob = s->corruptprob;
+  p->corruptdirection = 2;
+  p->lambda = 10.0;
+  p->seed = 9999;
+  p->windowsize = s->windowsize;
+  p->rtt = 16.0;
+  p->adaptiverto = 1;        /* a fixed timeout collapses under a large window */
+  p->dupthreshold = 3;
+  p->ackevery = 1;
+  p->ackdelay = 4.0;
+  p->bidirectional = 0;
+  p->protocol = PROTO_GBN;
+  p->checksum = CHECKSUM_DEFAULT;
+  p->payloadsize = 20;
+  p->connections = 1;
+  p->linkrate = s->linkrate;
+  p->propdelay = 1.0;
+  p->linkbuffer = 64;
+}
+
+/* a packet of the scenario's payload, from the pool of the run started */
+static struct pkt *benchpacket(struct emulator *emu, const struct params *params)
+{
+  struct pkt *packet = pktalloc(getpktpool(emu));
+
+  packet->seqnum = 0;
+  packet->acknum = 0;
+  packet->checksum = 0;
+  packet->length = params->payloadsize;
+  memset(packet->payload, 'a', params->payloadsize);
+  return packet;
+}
+
+/* CPU nanoseconds per start and stop of A's timer, over a heap holding a
+   window of packets in flight.  The timers expire at scattered times, so
+   that they land all over the heap */
+static double timetimers(struct emulator *emu, const struct params *params)
+{
+  struct pkt *packet;
+  unsigned int x = 1;
+  double start;
+  int i;
+
+  startemulator(emu, params);
+  packet = benchpacket(emu, params);
+  for (i=0; i<params->windowsize; i++)
+    tolayer3(emu, A, packet);
+  pktrelease(getpktpool(emu), packet);
+
+  start = cputime();
+  for (i=0; i<TIMERCALLS; i++) {
+    x = x * 1103515245 + 12345;
+    starttimer(emu, A, (x >> 16) % 512);
+    stoptimer(emu, A);
+  }
+  return (cputime() - start) * 1e9 / TIMERCALLS;
+}
+
+/* CPU nanoseconds per tolayer3() call, sending SENDBATCH packets from A
+   into a fresh run.  The link buffer is unbounded, so every packet is
+   scheduled rather than most dropped by a full buffer */
+static double timesends(struct emulator *emu, const struct params *params)
+{
+  struct params sendparams = *params;
+  struct pkt *packet;
+  double start, cpu;
+  int i;
+
+  sendparams.linkbuffer = QUEUEUNBOUNDED;
+  startemulator(emu, &sendparams);
+  packet = benchpacket(emu, &sendparams);
+  start = cputime();
+  for (i=0; i<SENDBATCH; i++)
+    tolayer3(emu, A, packet);
+  cpu = cputime() - start;
+  pktrelease(getpktpool(emu), packet);
+  return cpu * 1e9 / SENDBATCH;
+}
+
+/* run a scenario in this process */
+static void runscenario(const struct scenario *s, int messages, struct result *r)
+{
+  struct emulator *emu = newemulator();
+  struct params params;
+  struct stats stats;
+  double start, wall, cpu, total = 0.0, ns;
+  int i;
+
+  /* the short scenarios are over in milliseconds, so a slow spell could
+     last all of their repeats; they go on for MINCPU */
+  scenarioparams(s, messages, &params);
+  for (i=0; i<REPEATS || total < MINCPU; i++) {
+    wall = walltime();
+    start = cputime();
+    runemulator(emu, &params, &stats);
+    cpu = cputime() - start;
+    wall = walltime() - wall;
+    total += cpu;
+    if (i == 0 || cpu < r->cpu)
+      r->cpu = cpu;
+    if (i == 0 || wall < r->wall)
+      r->wall = wall;
+  }
+  r->events = stats.events;
+  r->delivered = stats.messages_delivered;
+  r->eventrate = r->cpu > 0.0 ? stats.events / r->cpu : 0.0;
+  r->eventns = stats.events > 0 ? r->cpu * 1e9 / stats.events : 0.0;
+  r->inserts = stats.events > 0 ? (double)stats.inserts / stats.events : 0.0;
+  r->sends = stats.events > 0 ? (double)stats.ntolayer3 / stats.events : 0.0;
+
+  start = cputime();
+  for (i=0; i<REPEATS || cputime() - start < MINCPU; i++) {
+    ns = timetimers(emu, &params);
+    if (i == 0 || ns < r->timerns)
+      r->timerns = ns;
+  }
+  start = cputime();
+  for (i=0; i<REPEATS || cputime() - start < MINCPU; i++) {
+    ns = timesends(emu, &params);
+    if (i == 0 || ns < r->sendns)
+      r->sendns = ns;
+  }
+  freeemulator(emu);
+}
+
+/* run a scenario in a child process, which reports back through a pipe */
+static void runchild(const struct scenario *s, int messages, struct result *r)
+{
+  struct rusage usage;
+  int fds[2], status;
+  pid_t pid;
+
+  if (pipe(fds) != 0 || (pid = fork()) < 0) {
+    printf("unable to start a benchmark process\n");
+    exit(EXIT_FAILURE);
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    memset(r, 0, sizeof(*r));
+    runscenario(s, messages, r);
+    _exit(write(fds[1], r, sizeof(*r)) == sizeof(*r) ? 0 : 1);
+  }
+  close(fds[1]);
+  if (read(fds[0], r, sizeof(*r)) != sizeof(*r) ||
+      wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    printf("benchmark of %s failed\n", s->name);
+    exit(EXIT_FAILURE);
+  }
+  close(fds[0]);
+  snprintf(r->name, sizeof(r->name), "%s", s->name);
+  r->rsskb = usage.ru_maxrss;   /* in kilobytes on Linux */
+}
+
+/* run a scenario in PROCESSES children and keep the best of each figure:
+   how fast a process runs also depends on where its memory landed */
+static void benchscenario(const struct scenario *s, int messages, struct result *r)
+{
+  struct result child;
+  int i;
+
+  runchild(s, messages, r);
+  for (i=1; i<PROCESSES; i++) {
+    runchild(s, messages, &child);
+    if (child.events != r->events || child.delivered != r->delivered) {
+      printf("benchmark of %s is not deterministic\n", s->name);
+      exit(EXIT_FAILURE);
+    }
+    if (child.wall < r->wall)
+      r->wall = child.wall;
+    if (child.cpu < r->cpu) {
+      r->cpu = child.cpu;
+      r->eventrate = child.eventrate;
+      r->eventns = child.eventns;
+    }
+    if (child.timerns < r->timerns)
+      r->timerns = child.timerns;
+    if (child.sendns < r->sendns)
+      r->sendns = child.sendns;
+    if (child.rsskb < r->rsskb)
+      r->rsskb = child.rsskb;
+  }
+}
+
+static void printheader(FILE *f, int messages)
+{
+  fprintf(f, "# emulatorbench: %d messages per run, GBN, TRACE 0\n", messages);
+  fprintf(f, "# %-16s %8s %9s %7s %7s %9s %8s %7s %7s %8s %8s %7s\n", "scenario",
+          "events", "delivered", "wall s", "cpu s", "events/s", "ns/event", "ins/ev",
+          "send/ev", "ns/timer", "ns/send", "RSS KB");
+}
+
+static void printresult(FILE *f, const struct result *r)
+{
+  fprintf(f, "%-18s %8ld %9ld %7.4f %7.4f %9.0f %8.1f %7.3f %7.3f %8.1f %8.1f %7ld\n",
+          r->name, r->events, r->delivered, r->wall, r->cpu, r->eventrate, r->eventns,
+          r->inserts, r->sends, r->timerns, r->sendns, r->rsskb);
+}
+
+/* read the results of a baseline, returning how many there are */
+static int readbaseline(const char *path, struct result *base, int max)
+{
+  char line[256];
+  FILE *f;
+  int n = 0;
+
+  if ((f = fopen(path, "r")) == NULL) {
+    printf("unable to open baseline %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  while (n < max && fgets(line, sizeof(line), f) != NULL) {
+    if (line[0] == '#' || line[0] == '\n')
+      continue;
+    if (sscanf(line, "%31s %ld %ld %lf %lf %lf %lf %lf %lf %lf %lf %ld", base[n].name,
+               &base[n].events, &base[n].delivered, &base[n].wall, &base[n].cpu,
+               &base[n].eventrate, &base[n].eventns, &base[n].inserts, &base[n].sends,
+               &base[n].timerns, &base[n].sendns, &base[n].rsskb) != 12) {
+      printf("baseline %s has a malformed line: %s", path, line);
+      exit(EXIT_FAILURE);
+    }
+    n++;
+  }
+  fclose(f);
+  return n;
+}
+
+/* percent change of a cost, and whether it is a regression */
+static int change(const char *what, double now, double then, double threshold)
+{
+  double percent = then > 0.0 ? 100.0 * (now - then) / then : 0.0;
+
+  printf("  %s %+6.1f%%", what, percent);
+  return percent > threshold;
+}
+
+/* compare the results against a baseline, returning nonzero on a regression */
+static int compare(const struct result *results, const struct result *base, int nbase,
+                   double threshold)
+{
+  const struct result *r, *b;
+  int failed = 0, bad, i, j;
+
+  printf("\nchanges against the baseline, costs over %.0f%% or RSS over %.0f%% and %d KB marked:\n",
+         threshold, RSSTHRESHOLD, RSSSLACK);
+  for (i=0; i<NSCENARIOS; i++) {
+    r = &results[i];
+    for (j=0; j<nbase && strcmp(base[j].name, r->name) != 0; j++)
+      ;
+    if (j == nbase) {
+      printf("%-18s not in the baseline\n", r->name);
+      continue;
+    }
+    b = &base[j];
+    printf("%-18s", r->name);
+    bad = change("ns/event", r->eventns, b->eventns, threshold);
+    bad |= change("ns/timer", r->timerns, b->timerns, threshold);
+    bad |= change("ns/send", r->sendns, b->sendns, threshold);
+    bad |= change("RSS", r->rsskb, b->rsskb, RSSTHRESHOLD) && r->rsskb - b->rsskb > RSSSLACK;
+    printf("%s\n", bad ? "  REGRESSION" : "");
+    if (r->events != b->events || r->delivered != b->delivered) {
+      printf("%-18s  events %ld, delivered %ld, baseline has %ld and %ld\n", "",
+             r->events, r->delivered, b->events, b->delivered);
+      bad = 1;
+    }
+    failed |= bad;
+  }
+  return failed;
+}
+
+int main(int argc, char *argv[])
+{
+  struct result results[NSCENARIOS], base[NSCENARIOS];
+  const char *outpath = NULL, *basepath = NULL;
+  double threshold = THRESHOLD;
+  int messages = MESSAGES;
+  int nbase = 0, opt, i;
+  FILE *out;
+
+  while ((opt = getopt(argc, argv, "n:o:c:t:")) != -1) {
+    switch (opt) {
+    case 'n':
+      messages = atoi(optarg);
+      break;
+    case 'o':
+      outpath = optarg;
+      break;
+    case 'c':
+      basepath = optarg;
+      break;
+    case 't':
+      threshold = atof(optarg);
+      break;
+    default:
+      printf("usage: %s [-n messages] [-o baseline] [-c baseline] [-t percent]\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (messages < 1) {
+    printf("%s: messages must be at least 1\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (basepath != NULL)
+    nbase = readbaseline(basepath, base, NSCENARIOS);
+
+  TRACE = 0;
+  tracefile = stdout;
+
+  printheader(stdout, messages);
+  fflush(stdout);
+  for (i=0; i<NSCENARIOS; i++) {
+    benchscenario(&scenarios[i], messages, &results[i]);
+    printresult(stdout, &results[i]);
+    fflush(stdout);
+  }
+
+  if (outpath != NULL) {
+    if ((out = fopen(outpath, "w")) == NULL) {
+      printf("unable to write baseline %s\n", outpath);
+      exit(EXIT_FAILURE);
+    }
+    printheader(out, messages);
+    for (i=0; i<NSCENARIOS; i++)
+      printresult(out, &results[i]);
+    fclose(out);
+  }
+  if (basepath != NULL)
+    return compare(results, base, nbase, threshold);
+  return 0;
+}
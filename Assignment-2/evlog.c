@@ -0,0 +1,231 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "emulator.h"
+#include "evlog.h"
+
+/* Binary event logs, written and replayed by the emulator. */
+
+#define EVLOGBUF     (1 << 20)   /* bytes written at a time */
+#define EVLOGMAGIC   "CNAEVLOG"
+#define EVLOGVERSION 2
+
+/* the start of a log, followed by the parameters of the run */
+struct evlogheader {
+  char magic[8];
+  uint32_t version;
+  uint32_t paramsize;      /* sizeof(struct params) of the writer */
+};
+
+static void flush(struct evlogwriter *w)
+{
+  if (w->used > 0 && fwrite(w->buf, 1, w->used, w->file) != w->used) {
+    printf("unable to write event log\n");
+    exit(EXIT_FAILURE);
+  }
+  w->used = 0;
+}
+
+static void put(struct evlogwriter *w, const void *data, size_t n)
+{
+  if (w->used + n > EVLOGBUF)
+    flush(w);
+  memcpy(w->buf + w->used, data, n);
+  w->used += n;
+}
+
+void evlogcreate(struct evlogwriter *w, const char *path, const struct params *params)
+{
+  struct evlogheader header;
+
+  if ((w->file = fopen(path, "wb")) == NULL) {
+    printf("unable to open event log %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  w->buf = malloc(EVLOGBUF);
+  if (w->buf == NULL) {
+    printf("memory allocation for event log failed.");
+    exit(EXIT_FAILURE);
+  }
+  w->used = 0;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, EVLOGMAGIC, sizeof(header.magic));
+  header.version = EVLOGVERSION;
+  header.paramsize = sizeof(struct params);
+  put(w, &header, sizeof(header));
+  put(w, params, sizeof(struct params));
+}
+
+static void putrecord(struct evlogwriter *w, double time, int type, int entity, int conn,
+                      const struct pkt *packet, int flags)
+{
+  struct evrecord r;
+
+  memset(&r, 0, sizeof(r));
+  r.time = time;
+  r.type = type;
+  r.entity = entity;
+  r.conn = conn;
+  if (packet != NULL) {
+    r.seqnum = packet->seqnum;
+    r.acknum = packet->acknum;
+    r.checksum = packet->checksum;
+    r.length = packet->length;
+  }
+  r.flags = flags;
+  put(w, &r, sizeof(r));
+}
+
+/* an event dispatched at time to entity of a connection, with the packet it delivers */
+void evlogevent(struct evlogwriter *w, double time, int type, int entity, int conn,
+                const struct pkt *packet)
+{
+  int i;
+
+  if (type != EVLOG_LAYER3) {
+    putrecord(w, time, type, entity, conn, NULL, 0);
+    return;
+  }
+  for (i=2; i<packet->length; i++)
+    if (packet->payload[i] != packet->payload[1])
+      break;
+  if (i >= packet->length && packet->length >= 2) {
+    putrecord(w, time, type, entity, conn, packet, EVLOG_UNIFORM);
+    put(w, packet->payload, 2);
+  }
+  else {
+    putrecord(w, time, type, entity, conn, packet, 0);
+    put(w, packet->payload, packet->length);
+  }
+}
+
+/* a packet sent by entity of a connection, and what the channel did with it */
+void evlogsend(struct evlogwriter *w, double time, int entity, int conn,
+               const struct pkt *packet, int flags)
+{
+  putrecord(w, time, EVLOG_SEND, entity, conn, packet, flags);
+}
+
+void evlogclose(struct evlogwriter *w)
+{
+  flush(w);
+  if (fclose(w->file) != 0) {
+    printf("unable to write event log\n");
+    exit(EXIT_FAILURE);
+  }
+  free(w->buf);
+  w->buf = NULL;
+}
+
+static void badlog(void)
+{
+  printf("event log is truncated or was written by a different build\n");
+  exit(EXIT_FAILURE);
+}
+
+/* true if the recorded parameters are within the bounds the command line
+   holds a run to, so that they are safe to index tables with and to size
+   the buffers of the replay by */
+static int validparams(const struct params *p)
+{
+  int seqspace, minseqspace;
+
+  if (p->protocol != PROTO_GBN && p->protocol != PROTO_SR)
+    return 0;
+  if (p->checksum < CHECKSUM_SUM || p->checksum > CHECKSUM_CRC32C)
+    return 0;
+  if (p->arrivals < ARRIVAL_UNIFORM || p->arrivals > ARRIVAL_TRACE)
+    return 0;
+  if (p->payloadsize < 1 || p->payloadsize > MAXPAYLOAD)
+    return 0;
+  if (p->connections < 1 || p->connections > 1000000)
+    return 0;
+  if (p->windowsize < 1 || p->windowsize > 1000000)
+    return 0;
+
+  /* the sequence space must tell apart every packet the window can hold */
+  minseqspace = p->protocol == PROTO_SR ? 2 * p->windowsize : p->windowsize + 1;
+  seqspace = p->seqspace != 0 ? p->seqspace : minseqspace;
+  if (seqspace < minseqspace || seqspace > MAXSEQSPACE)
+    return 0;
+  return p->checksum != CHECKSUM_INET || seqspace <= INETMAXSEQSPACE;
+}
+
+void evlogopen(struct evlogreader *r, const char *path)
+{
+  struct evlogheader header;
+  struct stat st;
+  void *map;
+  int fd;
+
+  if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+    printf("unable to open event log %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  r->size = st.st_size;
+  if (r->size < sizeof(header) + sizeof(struct params))
+    badlog();
+  map = mmap(NULL, r->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    printf("unable to map event log %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  r->map = map;
+
+  memcpy(&header, r->map, sizeof(header));
+  if (memcmp(header.magic, EVLOGMAGIC, sizeof(header.magic)) != 0 ||
+      header.version != EVLOGVERSION || header.paramsize != sizeof(struct params))
+    badlog();
+  memcpy(&r->params, r->map + sizeof(header), sizeof(struct params));
+  if (!validparams(&r->params))
+    badlog();
+  r->pos = sizeof(header) + sizeof(struct params);
+}
+
+int evlogpeek(const struct evlogreader *r)
+{
+  if (r->pos + sizeof(struct evrecord) > r->size)
+    return -1;
+  return r->map[r->pos + offsetof(struct evrecord, type)];
+}
+
+void evlognext(struct evlogreader *r, struct evrecord *rec, struct pkt *packet)
+{
+  size_t n;
+
+  if (r->pos + sizeof(struct evrecord) > r->size)
+    badlog();
+  memcpy(rec, r->map + r->pos, sizeof(struct evrecord));
+  r->pos += sizeof(struct evrecord);
+  if (rec->type > EVLOG_SEND || rec->entity > B ||
+      rec->conn < 0 || rec->conn >= r->params.connections)
+    badlog();
+  if (rec->type != EVLOG_LAYER3)
+    return;
+
+  if (rec->length < 0 || rec->length > MAXPAYLOAD)
+    badlog();
+  packet->seqnum = rec->seqnum;
+  packet->acknum = rec->acknum;
+  packet->checksum = rec->checksum;
+  packet->length = rec->length;
+  n = (rec->flags & EVLOG_UNIFORM) ? 2 : (size_t)rec->length;
+  if (r->pos + n > r->size)
+    badlog();
+  memcpy(packet->payload, r->map + r->pos, n);
+  if (rec->flags & EVLOG_UNIFORM)
+    memset(packet->payload + 2, packet->payload[1], rec->length - 2);
+  r->pos += n;
+}
+
+void evlogunmap(struct evlogreader *r)
+{
+  munmap((void *)r->map, r->size);
+  r->map = NULL;
+}
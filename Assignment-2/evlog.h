@@ -0,0 +1,70 @@
+/* Binary event logs.  A recorded run writes one fixed size record per
+   event dispatched by the emulator, in dispatch order, and one per packet
+   the protocol hands to layer 3 with the channel's decision on it, each
+   with the connection it belongs to.  A packet delivered from layer 3 is
+   followed by its payload, which takes two bytes when every byte after
+   the first is the same, as in every message the emulator generates.
+   The log starts with the parameters of the run, so that it can be
+   replayed into the same protocol configuration.  Logs are in the byte
+   order of the machine that wrote them. */
+
+#include <stdint.h>
+
+/* record types: the emulator's event types, and the packets it was sent */
+#define  EVLOG_TIMER   0      /* TIMER_INTERRUPT */
+#define  EVLOG_LAYER5  1      /* FROM_LAYER5 */
+#define  EVLOG_LAYER3  2      /* FROM_LAYER3, with the packet delivered */
+#define  EVLOG_SEND    3      /* a call of tolayer3(), with the packet sent */
+
+/* flags of a record */
+#define  EVLOG_LOST     0x01  /* the channel dropped the packet sent */
+#define  EVLOG_CORRUPT  0x02  /* the channel corrupted the packet sent */
+#define  EVLOG_UNIFORM  0x04  /* payload[1..] all equal, two payload bytes follow */
+#define  EVLOG_QUEUEDROP 0x08 /* the full queue of the link dropped the packet sent */
+#define  EVLOG_EARLYDROP 0x10 /* RED dropped the packet sent early */
+
+struct evrecord {
+  double time;
+  uint8_t type;            /* EVLOG_* */
+  uint8_t entity;          /* A or B, where the event occurs or the sender */
+  uint8_t flags;
+  uint8_t unused;
+  int32_t seqnum;          /* header of the packet, for EVLOG_LAYER3 and EVLOG_SEND */
+  int32_t acknum;
+  int32_t checksum;
+  int32_t length;
+  int32_t conn;            /* connection of the event or the packet sent */
+};
+
+/* a log being written.  Records are collected in a large buffer and
+   written out a buffer at a time */
+struct evlogwriter {
+  FILE *file;
+  unsigned char *buf;
+  size_t used;
+};
+
+/* a log being replayed, mapped into memory */
+struct evlogreader {
+  const unsigned char *map;
+  size_t size;
+  size_t pos;              /* offset of the next record */
+  struct params params;    /* parameters of the recorded run */
+};
+
+/* create a log for a run with the given parameters */
+extern void evlogcreate(struct evlogwriter *, const char *, const struct params *);
+extern void evlogevent(struct evlogwriter *, double, int, int, int, const struct pkt *);
+extern void evlogsend(struct evlogwriter *, double, int, int, const struct pkt *, int);
+extern void evlogclose(struct evlogwriter *);
+
+/* map a log for replay, reading the parameters of the run; exits if they
+   are out of the range the command line allows */
+extern void evlogopen(struct evlogreader *, const char *);
+
+/* the type of the next record, -1 at the end of the log */
+extern int evlogpeek(const struct evlogreader *);
+
+/* read the next record, and for EVLOG_LAYER3 the packet into packet */
+extern void evlognext(struct evlogreader *, struct evrecord *, struct pkt *);
+extern void evlogunmap(struct evlogreader *);
@@ -1,12 +1,21 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include "emulator.h"
+#include "trace.h"
+#include "checksum.h"
+#include "rto.h"
+#include "cwnd.h"
+#include "msgqueue.h"
+#include "pktpool.h"
+#include "seqspace.h"
+#include "ack.h"
 #include "gbn.h"
 
 /* ******************************************************************
    Go Back N protocol.  Adapted from J.F.Kurose
-   ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.2  
+   ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.2
 
    Network properties:
    - one way network delay averages five time units (longer if there
@@ -16,260 +25,557 @@
    - packets will be delivered in the order in which they were sent
    (although some can be lost).
 
-   Modifications: 
-   - removed bidirectional GBN code and other code not used by prac. 
+   Modifications:
+   - removed bidirectional GBN code and other code not used by prac.
    - fixed C style to adhere to current programming style
    - added GBN implementation
+   - added bidirectional transfer (--bidirectional): each end runs a
+   sender and a receiver, every data packet carries the cumulative ACK
+   of its sender's receiver, and ACK-only packets are sent only when no
+   data goes out in time to carry the ACK
+   - added congestion control (--congestion): the packets outstanding are
+   limited by an AIMD congestion window (cwnd.c), and after a loss the
+   sender goes back to the window base but resends only as many packets
+   as the cut window lets out, the rest as ACKs open it again
 **********************************************************************/
 
-#define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
-#define WINDOWSIZE 6    /* the maximum number of buffered unacked packet */
-#define SEQSPACE 7      /* the min sequence space for GBN must be at least windowsize + 1 */
-#define NOTINUSE (-1)   /* used to fill header fields that are not being used */
+/* The window size, sequence space and RTT are run parameters (--window,
+   --seqspace and --rtt), the defaults are 6, windowsize + 1 and 16.0.
+   RTT MUST BE 16.0 when submitting assignment.  With --adaptive-rto the
+   timer follows the measured round trip time instead (rto.c).
+   All protocol state lives in struct gbn (gbn.h), so that independent
+   simulations can run side by side. */
+static void resendpacket(struct gbn *, struct gbnend *, int);
+static void goback(struct gbn *, struct gbnend *, bool);
+static void resendwindow(struct gbn *, struct gbnend *);
+
+/* the sequence space of a run: the min sequence space for GBN must be at
+   least windowsize + 1, which is also the default */
+static int gbnseqspace(const struct params *params)
+{
+  if (params->seqspace != 0)
+    return params->seqspace;
+  return params->windowsize + 1;
+}
 
-/* generic procedure to compute the checksum of a packet.  Used by both sender and receiver  
-   the simulator will overwrite part of your packet with 'z's.  It will not overwrite your 
-   original checksum.  This procedure must generate a different checksum to the original if
-   the packet is corrupted.
-*/
-int ComputeChecksum(struct pkt packet)
+/* arm the entity's timer for the earlier of the retransmission and the
+   delayed ACK deadlines, or stop it if neither is set */
+static void armtimer(struct gbn *g, struct gbnend *e)
 {
-  int checksum = 0;
-  int i;
+  double next = e->rtxdeadline;
 
-  checksum = packet.seqnum;
-  checksum += packet.acknum;
-  for ( i=0; i<20; i++ ) 
-    checksum += (int)(packet.payload[i]);
+  if (e->ackdeadline >= 0.0 && (next < 0.0 || e->ackdeadline < next))
+    next = e->ackdeadline;
 
-  return checksum;
+  if (next < 0.0) {
+    if (e->timerrunning) {
+      stoptimer(g->emu, e->entity);
+      e->timerrunning = false;
+    }
+  }
+  else if (!e->timerrunning || next != e->armed) {
+    restarttimer(g->emu, e->entity, next - gettime(g->emu));
+    e->timerrunning = true;
+    e->armed = next;
+  }
 }
 
-bool IsCorrupted(struct pkt packet)
+/* cumulative ACK for the last packet received in order */
+static int lastreceived(struct gbn *g, struct gbnend *e)
 {
-  if (packet.checksum == ComputeChecksum(packet))
-    return (false);
-  else
-    return (true);
+  if (e->expectedseqnum == 0)
+    return g->seqspace - 1;
+  return e->expectedseqnum - 1;
 }
 
+/* with bidirectional transfer, put the cumulative ACK of this end's
+   receiver in an outgoing data packet.  It replaces any ACK that was
+   still to be sent on its own */
+static void piggyback(struct gbn *g, struct gbnend *e, struct pkt *packet)
+{
+  packet->acknum = lastreceived(g, e);
+  if (e->ackpending > 0 || e->ackdue)
+    g->stats->acks_piggybacked++;
+  e->ackpending = 0;
+  e->ackdue = false;
+  e->ackdeadline = -1.0;
+}
 
 /********* Sender (A) variables and functions ************/
 
-static struct pkt buffer[WINDOWSIZE];  /* array for storing packets waiting for ACK */
-static int windowfirst, windowlast;    /* array indexes of the first/last packet awaiting ACK */
-static int windowcount;                /* the number of packets currently awaiting an ACK */
-static int A_nextseqnum;               /* the next sequence number to be used by the sender */
+/* send a message in the next free window slot.  It arrived from layer 5
+   at time arrival, and may have waited in the queue since */
+static void sendmessage(struct gbn *g, struct gbnend *e, const struct msg *message, double arrival)
+{
+  struct pkt *sendpkt;
+  struct gbnsend *slot;
+
+  /* create packet in the window buffer */
+  /* windowlast will always be 0 for alternating bit; but not for GoBackN */
+  e->windowlast = (e->windowlast + 1) & e->bufmask;
+  slot = &e->buffer[e->windowlast];
+  sendpkt = slot->packet = pktalloc(g->pool);
+  sendpkt->seqnum = e->nextseqnum;
+  sendpkt->acknum = NOTINUSE;
+  if (g->bidirectional)
+    piggyback(g, e, sendpkt);
+  sendpkt->length = message->length;
+  memcpy(sendpkt->payload, message->data, message->length);
+  slot->payloadsum = g->checksum->payload(sendpkt->payload, sendpkt->length);
+  sendpkt->checksum = g->checksum->header(sendpkt, slot->payloadsum);
+
+  slot->sent = gettime(g->emu);
+  slot->resent = false;
+  e->windowcount++;
+  e->inflight++;
+  histadd(&g->stats->queuedelay, slot->sent - arrival);
 
-/* called from layer 5 (application layer), passed the message to be sent to other side */
-void A_output(struct msg message)
+  /* send out packet */
+  g->stats->packets_sent++;
+  TRACEF(1, "Sending packet %d to layer 3\n", sendpkt->seqnum);
+  tolayer3(g->emu, e->entity, sendpkt);
+
+  /* start timer if first packet in window */
+  if (e->windowcount == 1)
+    e->rtxdeadline = slot->sent + rtointerval(&e->rto);
+  armtimer(g, e);
+
+  /* get next sequence number, wrap back to 0 */
+  e->nextseqnum = seqwrap(e->nextseqnum + 1, g->seqspace, g->seqmask);
+}
+
+/* a message from layer 5 would be sent at once */
+static bool ready(struct gbnend *e)
 {
-  struct pkt sendpkt;
-  int i;
+  return e->windowcount < cwndlimit(&e->cwnd);
+}
 
+/* called from layer 5 (application layer), passed the message to be sent to other side */
+static void output(struct gbn *g, struct gbnend *e, const struct msg *message)
+{
   /* if not blocked waiting on ACK */
-  if ( windowcount < WINDOWSIZE) {
-    if (TRACE > 1)
-      printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
-
-    /* create packet */
-    sendpkt.seqnum = A_nextseqnum;
-    sendpkt.acknum = NOTINUSE;
-    for ( i=0; i<20 ; i++ ) 
-      sendpkt.payload[i] = message.data[i];
-    sendpkt.checksum = ComputeChecksum(sendpkt); 
-
-    /* put packet in window buffer */
-    /* windowlast will always be 0 for alternating bit; but not for GoBackN */
-    windowlast = (windowlast + 1) % WINDOWSIZE; 
-    buffer[windowlast] = sendpkt;
-    windowcount++;
-
-    /* send out packet */
-    if (TRACE > 0)
-      printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
-    tolayer3 (A, sendpkt);
-
-    /* start timer if first packet in window */
-    if (windowcount == 1)
-      starttimer(A,RTT);
-
-    /* get next sequence number, wrap back to 0 */
-    A_nextseqnum = (A_nextseqnum + 1) % SEQSPACE;  
+  if (ready(e)) {
+    TRACEF(2, "----%c: New message arrives, send window is not full, send new messge to layer3!\n", e->name);
+    sendmessage(g, e, message, gettime(g->emu));
+  }
+  /* if blocked, hold the message until the window slides */
+  else if (mqpush(&e->queue, message, gettime(g->emu))) {
+    TRACEF(1, "----%c: New message arrives, send window is full, message queued\n", e->name);
+    g->stats->messages_queued++;
   }
-  /* if blocked,  window is full */
+  /* if blocked and the queue is full */
   else {
-    if (TRACE > 0)
-      printf("----A: New message arrives, send window is full\n");
-    window_full++;
+    TRACEF(1, "----%c: New message arrives, send window is full\n", e->name);
+    g->stats->window_full++;
   }
 }
 
+/* send what the window has room for: first the packets the sender went
+   back to but has not resent yet, then queued messages */
+static void drainqueue(struct gbn *g, struct gbnend *e)
+{
+  const struct queued *item;
+  int limit = cwndlimit(&e->cwnd);
+
+  while (e->inflight < e->windowcount && e->inflight < limit)
+    resendpacket(g, e, e->inflight++);
+  while (e->windowcount < limit && e->queue.count > 0) {
+    item = mqpop(&e->queue);
+    TRACEF(2, "----%c: window has room, send queued message to layer3!\n", e->name);
+    sendmessage(g, e, &item->message, item->arrival);
+  }
+}
 
-/* called from layer 3, when a packet arrives for layer 4 
-   In this practical this will always be an ACK as B never sends data.
-*/
-void A_input(struct pkt packet)
+
+/* process the uncorrupted ACK in a packet.  Only ACK-only packets (pure)
+   count as duplicates, data packets repeat the last ACK as a matter of
+   course */
+static void ackinput(struct gbn *g, struct gbnend *e, const struct pkt *packet, bool pure)
 {
+  struct gbnsend *acked;
   int ackcount = 0;
   int i;
 
-  /* if received ACK is not corrupted */ 
-  if (!IsCorrupted(packet)) {
-    if (TRACE > 0)
-      printf("----A: uncorrupted ACK %d is received\n",packet.acknum);
-    total_ACKs_received++;
-
-    /* check if new ACK or duplicate */
-    if (windowcount != 0) {
-          int seqfirst = buffer[windowfirst].seqnum;
-          int seqlast = buffer[windowlast].seqnum;
-          /* check case when seqnum has and hasn't wrapped */
-          if (((seqfirst <= seqlast) && (packet.acknum >= seqfirst && packet.acknum <= seqlast)) ||
-              ((seqfirst > seqlast) && (packet.acknum >= seqfirst || packet.acknum <= seqlast))) {
-
-            /* packet is a new ACK */
-            if (TRACE > 0)
-              printf("----A: ACK %d is not a duplicate\n",packet.acknum);
-            new_ACKs++;
-
-            /* cumulative acknowledgement - determine how many packets are ACKed */
-            if (packet.acknum >= seqfirst)
-              ackcount = packet.acknum + 1 - seqfirst;
-            else
-              ackcount = SEQSPACE - seqfirst + packet.acknum;
-
-	    /* slide window by the number of packets ACKed */
-            windowfirst = (windowfirst + ackcount) % WINDOWSIZE;
-
-            /* delete the acked packets from window buffer */
-            for (i=0; i<ackcount; i++)
-              windowcount--;
-
-	    /* start timer again if there are still more unacked packets in window */
-            stoptimer(A);
-            if (windowcount > 0)
-              starttimer(A, RTT);
-
+  TRACEF(1, "----%c: uncorrupted ACK %d is received\n", e->name, packet->acknum);
+  g->stats->total_ACKs_received++;
+
+  /* check if new ACK or duplicate */
+  if (e->windowcount != 0) {
+        int seqfirst = e->buffer[e->windowfirst].packet->seqnum;
+        int seqlast = e->buffer[e->windowlast].packet->seqnum;
+        /* check case when seqnum has and hasn't wrapped */
+        if (((seqfirst <= seqlast) && (packet->acknum >= seqfirst && packet->acknum <= seqlast)) ||
+            ((seqfirst > seqlast) && (packet->acknum >= seqfirst || packet->acknum <= seqlast))) {
+
+          /* packet is a new ACK */
+          TRACEF(1, "----%c: ACK %d is not a duplicate\n", e->name, packet->acknum);
+          g->stats->new_ACKs++;
+          e->dupacks = 0;
+
+          /* cumulative acknowledgement - determine how many packets are ACKed */
+          if (packet->acknum >= seqfirst)
+            ackcount = packet->acknum + 1 - seqfirst;
+          else
+            ackcount = g->seqspace - seqfirst + packet->acknum;
+
+          /* time the round trip of the packet this ACK was sent for */
+          acked = &e->buffer[(e->windowfirst + ackcount - 1) & e->bufmask];
+          if (!acked->resent)
+            rtosample(&e->rto, gettime(g->emu) - acked->sent);
+          else
+            rtoresentacked(&e->rto, gettime(g->emu) - acked->sent);
+
+          /* slide window by the number of packets ACKed, deleting the
+             acked packets from window buffer */
+          for (i=0; i<ackcount; i++) {
+            pktrelease(g->pool, e->buffer[e->windowfirst].packet);
+            e->windowfirst = (e->windowfirst + 1) & e->bufmask;
+            e->windowcount--;
           }
+          e->inflight = (e->inflight > ackcount) ? e->inflight - ackcount : 0;
+          cwndacked(&e->cwnd, ackcount);
+
+          /* start timer again if there are still more unacked packets in window */
+          if (e->windowcount > 0)
+            e->rtxdeadline = gettime(g->emu) + rtointerval(&e->rto);
+          else
+            e->rtxdeadline = -1.0;
+          armtimer(g, e);
+
+          /* the window has room for queued messages again */
+          drainqueue(g, e);
         }
-        else
-          if (TRACE > 0)
-        printf ("----A: duplicate ACK received, do nothing!\n");
-  }
-  else 
-    if (TRACE > 0)
-      printf ("----A: corrupted ACK is received, do nothing!\n");
+        else if (pure && packet->acknum == seqwrap(seqfirst - 1 + g->seqspace, g->seqspace, g->seqmask)) {
+          /* the receiver is still waiting for the packet at the window base */
+          TRACEF(1, "----%c: duplicate ACK %d received\n", e->name, packet->acknum);
+          e->dupacks++;
+          if (e->dupacks == g->dupthreshold) {
+            /* don't wait for the timer, the base packet has probably been lost */
+            TRACEF(1, "----%c: %d duplicate ACKs, fast retransmit!\n", e->name, e->dupacks);
+            g->stats->fast_retransmits++;
+            goback(g, e, false);
+          }
+        }
+      }
+      else
+        TRACEF(1, "----%c: duplicate ACK received, do nothing!\n", e->name);
 }
 
-/* called when A's timer goes off */
-void A_timerinterrupt(void)
+/* called when the retransmission timer goes off */
+static void timeout(struct gbn *g, struct gbnend *e)
 {
-  int i;
+  TRACEF(1, "----%c: time out,resend packets!\n", e->name);
+  rtoexpired(&e->rto);
+  goback(g, e, true);
+}
 
-  if (TRACE > 0)
-    printf("----A: time out,resend packets!\n");
+/* a packet was lost, detected by the timer or by duplicate ACKs: go back
+   to the window base.  Under congestion control the window is cut first
+   and only what it lets out is resent now */
+static void goback(struct gbn *g, struct gbnend *e, bool timeout)
+{
+  if (!g->congestion) {
+    resendwindow(g, e);
+    return;
+  }
+  cwndlost(&e->cwnd, e->inflight, timeout);
+  TRACEF(2, "----%c: congestion window cut to %f, slow start threshold %f\n", e->name,
+         e->cwnd.cwnd, e->cwnd.ssthresh);
+  e->inflight = 0;
+  drainqueue(g, e);
+}
 
-  for(i=0; i<windowcount; i++) {
+/* resend the i-th packet of the window, restarting the timer for the
+   window base */
+static void resendpacket(struct gbn *g, struct gbnend *e, int i)
+{
+  struct gbnsend *slot = &e->buffer[(e->windowfirst+i) & e->bufmask];
 
-    if (TRACE > 0)
-      printf ("---A: resending packet %d\n", (buffer[(windowfirst+i) % WINDOWSIZE]).seqnum);
+  TRACEF(1, "---%c: resending packet %d\n", e->name, slot->packet->seqnum);
 
-    tolayer3(A,buffer[(windowfirst+i) % WINDOWSIZE]);
-    packets_resent++;
-    if (i==0) starttimer(A,RTT);
+  /* the ACK sent with the packet first time round is stale, and could
+     look new to the other side once the sequence numbers wrap.  The
+     first copy may still be in flight, so it is left alone */
+  if (g->bidirectional) {
+    slot->packet = pktunshare(g->pool, slot->packet);
+    piggyback(g, e, slot->packet);
+    slot->packet->checksum = g->checksum->header(slot->packet, slot->payloadsum);
   }
-}       
-
 
+  tolayer3(g->emu, e->entity, slot->packet);
+  slot->sent = gettime(g->emu);
+  slot->resent = true;
+  g->stats->packets_resent++;
+  if (i==0) {
+    e->rtxdeadline = slot->sent + rtointerval(&e->rto);
+    armtimer(g, e);
+  }
+}
 
-/* the following routine will be called once (only) before any other */
-/* entity A routines are called. You can use it to do any initialization */
-void A_init(void)
+/* go back N: resend every packet in the window and restart the timer */
+static void resendwindow(struct gbn *g, struct gbnend *e)
 {
-  /* initialise A's window, buffer and sequence number */
-  A_nextseqnum = 0;  /* A starts with seq num 0, do not change this */
-  windowfirst = 0;
-  windowlast = -1;   /* windowlast is where the last packet sent is stored.  
-		     new packets are placed in winlast + 1 
-		     so initially this is set to -1
-		   */
-  windowcount = 0;
+  int i;
+
+  for(i=0; i<e->windowcount; i++)
+    resendpacket(g, e, i);
 }
 
 
 
 /********* Receiver (B)  variables and procedures ************/
 
-static int expectedseqnum; /* the sequence number expected next by the receiver */
-static int B_nextseqnum;   /* the sequence number for the next packets sent by B */
 
-
-/* called from layer 3, when a packet arrives for layer 4 at B*/
-void B_input(struct pkt packet)
+/* acknowledge every packet delivered so far, including any whose ACK
+   was held back */
+static void sendack(struct gbn *g, struct gbnend *e)
 {
-  struct pkt sendpkt;
-  int i;
+  struct pkt *sendpkt;
+  int seqnum;
+
+  /* this ACK covers the ones held back */
+  e->ackpending = 0;
+  e->ackdue = false;
+  if (e->ackdeadline >= 0.0) {
+    e->ackdeadline = -1.0;
+    armtimer(g, e);
+  }
+
+  /* create packet, with no sequence number when data packets use them */
+  if (g->bidirectional)
+    seqnum = NOTINUSE;
+  else {
+    seqnum = e->ackseqnum;
+    e->ackseqnum = (e->ackseqnum + 1) % 2;
+  }
+  sendpkt = makeack(g->pool, g->checksum, seqnum, lastreceived(g, e));
+
+  /* send out packet, the emulator holds it from now on */
+  g->stats->acks_sent++;
+  tolayer3(g->emu, e->entity, sendpkt);
+  pktrelease(g->pool, sendpkt);
+}
 
+/* deliver a data packet if it is the one expected, and decide whether to
+   acknowledge it now (ackdue) or hold the ACK back */
+static void receive(struct gbn *g, struct gbnend *e, const struct pkt *packet)
+{
   /* if not corrupted and received packet is in order */
-  if  ( (!IsCorrupted(packet))  && (packet.seqnum == expectedseqnum) ) {
-    if (TRACE > 0)
-      printf("----B: packet %d is correctly received, send ACK!\n",packet.seqnum);
-    packets_received++;
+  if  ( (!IsCorrupted(g->checksum, packet))  && (packet->seqnum == e->expectedseqnum) ) {
+    TRACEF(1, "----%c: packet %d is correctly received, send ACK!\n", e->name, packet->seqnum);
+    g->stats->packets_received++;
 
     /* deliver to receiving application */
-    tolayer5(B, packet.payload);
-
-    /* send an ACK for the received packet */
-    sendpkt.acknum = expectedseqnum;
+    tolayer5(g->emu, e->entity, packet->payload, packet->length);
 
     /* update state variables */
-    expectedseqnum = (expectedseqnum + 1) % SEQSPACE;        
+    e->expectedseqnum = seqwrap(e->expectedseqnum + 1, g->seqspace, g->seqmask);
+
+    /* with delayed ACKs, hold the ACK back until ackevery packets are
+       waiting for one or the ACK timer expires.  With bidirectional
+       transfer a single packet's ACK waits as well, for a data packet
+       going the other way to carry it */
+    if (++e->ackpending < g->ackevery || (g->bidirectional && g->ackevery == 1)) {
+      TRACEF(1, "----%c: ACK for packet %d delayed\n", e->name, packet->seqnum);
+      g->stats->acks_suppressed++;
+      if (e->ackdeadline < 0.0) {
+        e->ackdeadline = gettime(g->emu) + g->ackdelay;
+        armtimer(g, e);
+      }
+      return;
+    }
   }
-  else {
-    /* packet is corrupted or out of order resend last ACK */
-    if (TRACE > 0) 
-      printf("----B: packet corrupted or not expected sequence number, resend ACK!\n");
-    if (expectedseqnum == 0)
-      sendpkt.acknum = SEQSPACE - 1;
+  else
+    /* packet is corrupted or out of order resend last ACK, at once so
+       that the sender sees the duplicate */
+    TRACEF(1, "----%c: packet corrupted or not expected sequence number, resend ACK!\n", e->name);
+
+  e->ackdue = true;
+}
+
+/* called from layer 3, when a packet arrives for layer 4 */
+static void input(struct gbn *g, struct gbnend *e, const struct pkt *packet)
+{
+  if (!g->bidirectional) {
+    /* A only receives ACKs, B only data */
+    if (e->entity == B)
+      receive(g, e, packet);
+    else if (!IsCorrupted(g->checksum, packet))
+      ackinput(g, e, packet, true);
     else
-      sendpkt.acknum = expectedseqnum - 1;
+      TRACEF(1, "----%c: corrupted ACK is received, do nothing!\n", e->name);
+  }
+  /* a corrupted packet may have been data or ACK-only, so it is not
+     acknowledged: the other side's timer recovers it */
+  else if (IsCorrupted(g->checksum, packet))
+    TRACEF(1, "----%c: corrupted packet is received, do nothing!\n", e->name);
+  else {
+    /* take the data first, so that data released by the ACK carries the
+       ACK for this packet */
+    if (packet->seqnum != NOTINUSE)
+      receive(g, e, packet);
+    ackinput(g, e, packet, packet->seqnum == NOTINUSE);
   }
 
-  /* create packet */
-  sendpkt.seqnum = B_nextseqnum;
-  B_nextseqnum = (B_nextseqnum + 1) % 2;
-    
-  /* we don't have any data to send.  fill payload with 0's */
-  for ( i=0; i<20 ; i++ ) 
-    sendpkt.payload[i] = '0';  
+  if (e->ackdue)
+    sendack(g, e);
+}
 
-  /* computer checksum */
-  sendpkt.checksum = ComputeChecksum(sendpkt); 
+/* called when an entity's timer goes off */
+static void timerinterrupt(struct gbn *g, struct gbnend *e)
+{
+  double expired = e->armed;
 
-  /* send out packet */
-  tolayer3 (B, sendpkt);
+  /* the timer was armed for the earlier deadline, which has expired
+     even if rounding of the clock leaves it just ahead */
+  e->timerrunning = false;
+  if (expired < gettime(g->emu))
+    expired = gettime(g->emu);
+
+  if (e->rtxdeadline >= 0.0 && e->rtxdeadline <= expired) {
+    e->rtxdeadline = -1.0;
+    timeout(g, e);
+  }
+  if (e->ackdeadline >= 0.0 && e->ackdeadline <= expired) {
+    TRACEF(1, "----%c: ACK timer expired, send delayed ACK!\n", e->name);
+
+    /* one of the ACKs held back is sent after all */
+    g->stats->acks_suppressed--;
+    sendack(g, e);
+  }
+  armtimer(g, e);
+}
+
+/* set up one end of the connection */
+static void endinit(struct gbn *g, struct gbnend *e, struct emulator *emu, int entity)
+{
+  const struct params *params = getparams(emu);
+  struct gbnsend *grown;
+
+  g->emu = emu;
+  g->stats = getstats(emu);
+  g->pool = getpktpool(emu);
+  g->checksum = getchecksum(params->checksum);
+  g->windowsize = params->windowsize;
+  g->seqspace = gbnseqspace(params);
+  g->seqmask = seqmaskof(g->seqspace);
+  g->dupthreshold = params->dupthreshold;
+  g->ackevery = params->ackevery;
+  g->ackdelay = params->ackdelay;
+  g->bidirectional = params->bidirectional != 0;
+  g->congestion = params->congestion != 0;
+
+  e->entity = entity;
+  e->name = (entity == A) ? 'A' : 'B';
+  rtoinit(&e->rto, emu, entity == A);
+  cwndinit(&e->cwnd, emu, entity, entity == A);
+
+  /* size the window buffer for the configured window, rounded up to a
+     power of two so that its indexes wrap with a mask */
+  e->bufmask = ringcapacity(g->windowsize) - 1;
+  grown = realloc(e->buffer, (e->bufmask + 1) * sizeof(struct gbnsend));
+  if (grown == NULL) {
+    printf("memory allocation for window buffer failed.");
+    exit(EXIT_FAILURE);
+  }
+  e->buffer = grown;
+
+  /* initialise the window, buffer and sequence number */
+  e->nextseqnum = 0;  /* A starts with seq num 0, do not change this */
+  e->windowfirst = 0;
+  e->windowlast = -1;   /* windowlast is where the last packet sent is stored.
+		     new packets are placed in winlast + 1
+		     so initially this is set to -1
+		   */
+  e->windowcount = 0;
+  e->inflight = 0;
+  e->dupacks = 0;
+  mqinit(&e->queue, params->queuelimit);
+  e->rtxdeadline = -1.0;
+
+  e->expectedseqnum = 0;
+  e->ackseqnum = 1;
+  e->ackpending = 0;
+  e->ackdue = false;
+  e->ackdeadline = -1.0;
+  e->timerrunning = false;
+}
+
+/* the following routine will be called once (only) before any other */
+/* entity A routines are called. You can use it to do any initialization */
+void A_init(struct gbn *g, struct emulator *emu)
+{
+  endinit(g, &g->ends[A], emu, A);
 }
 
 /* the following routine will be called once (only) before any other */
 /* entity B routines are called. You can use it to do any initialization */
-void B_init(void)
+void B_init(struct gbn *g, struct emulator *emu)
+{
+  endinit(g, &g->ends[B], emu, B);
+}
+
+void A_output(struct gbn *g, const struct msg *message)
+{
+  output(g, &g->ends[A], message);
+}
+
+bool A_ready(struct gbn *g)
 {
-  expectedseqnum = 0;
-  B_nextseqnum = 1;
+  return ready(&g->ends[A]);
+}
+
+/* called from layer 3, when a packet arrives for layer 4
+   Without bidirectional transfer this will always be an ACK as B never
+   sends data.
+*/
+void A_input(struct gbn *g, struct pkt *packet)
+{
+  input(g, &g->ends[A], packet);
+}
+
+/* called when A's timer goes off */
+void A_timerinterrupt(struct gbn *g)
+{
+  timerinterrupt(g, &g->ends[A]);
+}
+
+/* called from layer 3, when a packet arrives for layer 4 at B*/
+void B_input(struct gbn *g, struct pkt *packet)
+{
+  input(g, &g->ends[B], packet);
 }
 
 /******************************************************************************
- * The following functions need be completed only for bi-directional messages *
+ * The following functions are used only for bi-directional messages         *
  *****************************************************************************/
 
 /* Note that with simplex transfer from a-to-B, there is no B_output() */
-void B_output(struct msg message)  
+void B_output(struct gbn *g, const struct msg *message)
 {
+  output(g, &g->ends[B], message);
 }
 
-/* called when B's timer goes off */
-void B_timerinterrupt(void)
+bool B_ready(struct gbn *g)
 {
+  return ready(&g->ends[B]);
 }
 
+/* called when B's timer goes off: a delayed ACK or, with bidirectional
+   transfer, a retransmission is due */
+void B_timerinterrupt(struct gbn *g)
+{
+  timerinterrupt(g, &g->ends[B]);
+}
+
+/* release the window buffers, the connection can be initialised again */
+void freegbn(struct gbn *g)
+{
+  int i;
+
+  for (i=0; i<2; i++) {
+    free(g->ends[i].buffer);
+    g->ends[i].buffer = NULL;
+    mqfree(&g->ends[i].queue);
+  }
+}
@@ -1,11 +1,76 @@
-extern void A_init(void);
-extern void B_init(void);
-extern void A_input(struct pkt);
-extern void B_input(struct pkt);
-extern void A_output(struct msg);
-extern void A_timerinterrupt(void);
-
-/* included for extension to bidirectional communication */
-#define BIDIRECTIONAL 0       /*  0 = A->B  1 =  A<->B */
-extern void B_output(struct msg);
-extern void B_timerinterrupt(void);
\ No newline at end of file
+/* a packet in the Go Back N sender window */
+struct gbnsend {
+  struct pkt *packet;      /* reference to the packet in the pool */
+  double sent;             /* time the packet was last sent */
+  bool resent;             /* retransmitted, so its round trip is ambiguous */
+  unsigned int payloadsum; /* checksum partial over the payload, for resending it with a new ACK */
+};
+
+/* one end of a Go Back N connection.  A sends and B receives; in
+   bidirectional mode both ends do both, and ACKs ride on data packets */
+struct gbnend {
+  int entity;              /* A or B */
+  char name;               /* 'A' or 'B', for the trace */
+
+  /* sender */
+  struct gbnsend *buffer;  /* array for storing packets waiting for ACK */
+  int bufmask;             /* buffer capacity - 1, the capacity is a power of two */
+  int windowfirst, windowlast;  /* array indexes of the first/last packet awaiting ACK */
+  int windowcount;         /* the number of packets currently awaiting an ACK */
+  int inflight;            /* packets from the window base sent since the sender last
+                              went back, fewer than windowcount while the congestion
+                              window holds back their resends */
+  int nextseqnum;          /* the next sequence number to be used by the sender */
+  int dupacks;             /* duplicate ACKs received for the packet before the window base */
+  struct msgqueue queue;   /* messages waiting for room in the window */
+  struct rto rto;          /* retransmission timeout of the sender */
+  struct cwnd cwnd;        /* congestion window of the sender */
+  double rtxdeadline;      /* time the retransmission timer expires, -1 if stopped */
+
+  /* receiver */
+  int expectedseqnum;      /* the sequence number expected next by the receiver */
+  int ackseqnum;           /* the sequence number for the next ACK-only packet */
+  int ackpending;          /* packets delivered since the last ACK */
+  bool ackdue;             /* an ACK must be sent before the current event ends */
+  double ackdeadline;      /* time a held back ACK is due, -1 if none */
+
+  /* the emulator has one timer per entity, armed for the earlier deadline */
+  bool timerrunning;
+  double armed;            /* deadline the timer is armed for */
+};
+
+/* state of one Go Back N connection between A and B */
+struct gbn {
+  struct emulator *emu;    /* the network this connection runs over */
+  struct stats *stats;     /* statistics of the current run */
+  struct pktpool *pool;    /* buffers of the packets */
+  const struct checksum *checksum;  /* packet checksum algorithm */
+  int windowsize;          /* the maximum number of buffered unacked packet */
+  int seqspace;            /* the sequence space, at least windowsize + 1 */
+  int seqmask;             /* seqspace - 1 if it is a power of two, otherwise 0 */
+  int dupthreshold;        /* duplicate ACKs that trigger a fast retransmit, 0 never */
+  int ackevery;            /* in order packets acknowledged together, 1 for every packet */
+  double ackdelay;         /* longest time an ACK is held back */
+  bool bidirectional;      /* both ends send data */
+  bool congestion;         /* the senders follow their congestion windows */
+  struct gbnend ends[2];   /* indexed by entity */
+};
+
+extern void A_init(struct gbn *, struct emulator *);
+extern void B_init(struct gbn *, struct emulator *);
+extern void A_input(struct gbn *, struct pkt *);
+extern void B_input(struct gbn *, struct pkt *);
+extern void A_output(struct gbn *, const struct msg *);
+extern void A_timerinterrupt(struct gbn *);
+
+/* true if A, or B, would send a message from layer 5 at once, rather than
+   queue or drop it; used by a saturating source */
+extern bool A_ready(struct gbn *);
+extern bool B_ready(struct gbn *);
+
+/* used for bidirectional communication */
+extern void B_output(struct gbn *, const struct msg *);
+extern void B_timerinterrupt(struct gbn *);
+
+/* release the memory held by a connection */
+extern void freegbn(struct gbn *);
@@ -0,0 +1,56 @@
+#include <math.h>
+#include "histogram.h"
+
+/* Logarithmic histograms, used for the delay statistics of a run. */
+
+void histadd(struct histogram *h, double x)
+{
+  double m;
+  int e, i;
+
+  if (x < ldexp(1.0, HISTMINEXP))
+    i = 0;
+  else {
+    /* x = m * 2^e with m in [0.5, 1) */
+    m = frexp(x, &e);
+    i = 1 + (e - 1 - HISTMINEXP) * HISTSUB + (int)((2.0 * m - 1.0) * HISTSUB);
+    if (i >= HISTBUCKETS)
+      i = HISTBUCKETS - 1;
+  }
+  h->buckets[i]++;
+  h->count++;
+  h->sum += x;
+  if (x > h->max)
+    h->max = x;
+}
+
+double histmean(const struct histogram *h)
+{
+  if (h->count == 0)
+    return 0.0;
+  return h->sum / h->count;
+}
+
+double histquantile(const struct histogram *h, double q)
+{
+  double rank, lo, width;
+  long seen = 0;
+  int i;
+
+  if (h->count == 0)
+    return 0.0;
+  rank = q * h->count;
+  for (i=0; i<HISTBUCKETS - 1; i++) {
+    seen += h->buckets[i];
+    if (seen >= rank && h->buckets[i] > 0)
+      break;
+  }
+  if (i == 0)
+    return 0.0;
+
+  /* the middle of the bucket, but never beyond the largest value */
+  lo = ldexp(1.0, HISTMINEXP + (i - 1) / HISTSUB);
+  width = lo / HISTSUB;
+  lo += ((i - 1) % HISTSUB) * width;
+  return fmin(lo + width / 2.0, h->max);
+}
@@ -0,0 +1,22 @@
+/* histogram of non-negative values with logarithmic buckets: each power
+   of two is split into HISTSUB equal buckets, so quantiles are accurate
+   to about 3% over the whole range while the histogram stays a fixed size
+   that can be copied with the statistics of a run.  Values below
+   2^HISTMINEXP fall in the first bucket and count as 0. */
+#define  HISTSUB     32
+#define  HISTMINEXP  (-8)
+#define  HISTMAXEXP  40
+#define  HISTBUCKETS ((HISTMAXEXP - HISTMINEXP) * HISTSUB + 1)
+
+struct histogram {
+  long count;              /* number of values added */
+  double sum;              /* sum of the values, for the mean */
+  double max;              /* largest value added */
+  int buckets[HISTBUCKETS];
+};
+
+extern void histadd(struct histogram *, double);
+extern double histmean(const struct histogram *);
+
+/* value below which a fraction q of the values lie, 0 if there are none */
+extern double histquantile(const struct histogram *, double);
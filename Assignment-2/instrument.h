@@ -0,0 +1,67 @@
+/* Instrumentation of the event loop.  Built with -DINSTRUMENT the
+   emulator keeps the length of the event list, the events dispatched of
+   each type, the use of the timers and the cycles spent in each protocol
+   callback, and the driver prints them with the statistics of each run.
+   Without it every INSTR() statement is removed at compile time, so the
+   hot paths carry no instrumentation at all; struct instrument stays in
+   the statistics either way, so that every file agrees on their layout. */
+
+#ifdef INSTRUMENT
+#define INSTRUMENTED 1
+#else
+#define INSTRUMENTED 0
+#endif
+
+/* the emulator's event types, TIMER_INTERRUPT, FROM_LAYER5 and FROM_LAYER3 */
+#define  NEVTYPES  3
+
+struct instrument {
+  long dispatched[NEVTYPES];   /* events dispatched of each type */
+  int evlistmax;               /* most events on the event list at once */
+  double evlistsum;            /* event list length summed over the events dispatched */
+  int timerstarts;             /* timers started, restarted and stopped */
+  int timerrestarts;
+  int timerstops;
+  int alreadystarted;          /* "already started" warnings of starttimer() */
+  int notrunning;              /* "wasn't running" warnings of stoptimer() */
+
+  /* calls of the protocol callback of A or B for each event type, i.e.
+     its timer interrupt, output and input routines, and their cycles */
+  long calls[2][NEVTYPES];
+  unsigned long long cycles[2][NEVTYPES];
+};
+
+#ifdef INSTRUMENT
+
+/* include statement only when instrumented */
+#define INSTR(...)  __VA_ARGS__
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+/* a cycle counter, or nanoseconds where the CPU has none we can read */
+static inline unsigned long long cyclecount(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  unsigned long long v;
+
+  __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(v));
+  return v;
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+#else
+
+#define INSTR(...)
+
+#endif
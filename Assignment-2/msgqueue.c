@@ -0,0 +1,73 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "emulator.h"
+#include "msgqueue.h"
+
+/* Sender message queues, shared by the GBN and Selective Repeat engines. */
+
+#define MQINITIAL 64          /* capacity of a queue when it first grows */
+
+void mqinit(struct msgqueue *q, int limit)
+{
+  q->head = 0;
+  q->count = 0;
+  q->limit = limit;
+}
+
+static void mqgrow(struct msgqueue *q)
+{
+  struct queued *grown;
+  const struct queued *item;
+  int capacity = (q->items == NULL) ? MQINITIAL : 2 * (q->mask + 1);
+  int i;
+
+  grown = malloc(capacity * sizeof(struct queued));
+  if (grown == NULL) {
+    printf("memory allocation for message queue failed.");
+    exit(EXIT_FAILURE);
+  }
+  for (i=0; i<q->count; i++) {
+    item = &q->items[(q->head + i) & q->mask];
+    grown[i].arrival = item->arrival;
+    grown[i].message.length = item->message.length;
+    memcpy(grown[i].message.data, item->message.data, item->message.length);
+  }
+  free(q->items);
+  q->items = grown;
+  q->head = 0;
+  q->mask = capacity - 1;
+}
+
+bool mqpush(struct msgqueue *q, const struct msg *message, double arrival)
+{
+  struct queued *item;
+
+  if (q->limit != QUEUEUNBOUNDED && q->count >= q->limit)
+    return false;
+  if (q->items == NULL || q->count > q->mask)
+    mqgrow(q);
+  item = &q->items[(q->head + q->count) & q->mask];
+  item->message.length = message->length;
+  memcpy(item->message.data, message->data, message->length);
+  item->arrival = arrival;
+  q->count++;
+  return true;
+}
+
+const struct queued *mqpop(struct msgqueue *q)
+{
+  const struct queued *item = &q->items[q->head];
+
+  q->head = (q->head + 1) & q->mask;
+  q->count--;
+  return item;
+}
+
+/* release the ring, the queue can be initialised again */
+void mqfree(struct msgqueue *q)
+{
+  free(q->items);
+  q->items = NULL;
+  q->mask = 0;
+}
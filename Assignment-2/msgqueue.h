@@ -0,0 +1,26 @@
+/* a message waiting at the sender for room in the window */
+struct queued {
+  struct msg message;
+  double arrival;          /* time the message arrived from layer 5 */
+};
+
+/* FIFO of messages in front of the send window.  The ring grows by
+   doubling, up to limit messages */
+struct msgqueue {
+  struct queued *items;
+  int head;                /* index of the oldest message */
+  int count;               /* number of messages queued */
+  int mask;                /* ring capacity - 1, the capacity is a power of two */
+  int limit;               /* most messages held, QUEUEUNBOUNDED for no limit */
+};
+
+extern void mqinit(struct msgqueue *, int);
+
+/* append a message, false if the queue is at its limit */
+extern bool mqpush(struct msgqueue *, const struct msg *, double);
+
+/* remove the oldest message, the queue must not be empty.  The message
+   stays valid until the next push */
+extern const struct queued *mqpop(struct msgqueue *);
+
+extern void mqfree(struct msgqueue *);
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include "emulator.h"
+#include "pktpool.h"
+
+/* Packet buffers, carved out of slabs and recycled through a freelist like
+   the events of the emulator.  Each buffer ends after the payload size of
+   the pool, so with the default 20 byte payload a buffer takes 48 bytes
+   instead of the 1488 of a full MAXPAYLOAD packet. */
+
+#define PKTSLAB 64            /* buffers allocated per slab */
+
+struct pktslab {
+  struct pktslab *next;
+  struct pktbuf bufs[];    /* PKTSLAB buffers, pool->stride bytes apart */
+};
+
+static struct pktbuf *bufof(struct pkt *packet)
+{
+  return (struct pktbuf *)((char *)packet - offsetof(struct pktbuf, packet));
+}
+
+/* the i-th buffer of a slab */
+static struct pktbuf *slabbuf(struct pktpool *pool, struct pktslab *slab, int i)
+{
+  return (struct pktbuf *)((char *)slab->bufs + i * pool->stride);
+}
+
+/* put the buffers of a slab on the freelist */
+static void freeslab(struct pktpool *pool, struct pktslab *slab)
+{
+  struct pktbuf *buf;
+  int i;
+
+  for (i=PKTSLAB-1; i>=0; i--) {
+    buf = slabbuf(pool, slab, i);
+    buf->refs = 0;
+    buf->next = pool->free;
+    pool->free = buf;
+  }
+}
+
+static void growpool(struct pktpool *pool)
+{
+  struct pktslab *slab;
+
+  slab = malloc(sizeof(struct pktslab) + PKTSLAB * pool->stride);
+  if (slab == NULL) {
+    printf("memory allocation for packet failed.");
+    exit(EXIT_FAILURE);
+  }
+  slab->next = pool->slabs;
+  pool->slabs = slab;
+  freeslab(pool, slab);
+}
+
+void pktpoolreset(struct pktpool *pool, int payloadsize)
+{
+  struct pktslab *slab;
+  size_t align = _Alignof(struct pktbuf);
+
+  if (payloadsize != pool->payloadsize) {
+    pktpoolfree(pool);
+    pool->payloadsize = payloadsize;
+    pool->stride = offsetof(struct pktbuf, packet.payload) + payloadsize;
+    pool->stride = (pool->stride + align - 1) / align * align;
+  }
+  pool->free = NULL;
+  for (slab = pool->slabs; slab != NULL; slab = slab->next)
+    freeslab(pool, slab);
+}
+
+void pktpoolfree(struct pktpool *pool)
+{
+  struct pktslab *slab;
+
+  while ((slab = pool->slabs) != NULL) {
+    pool->slabs = slab->next;
+    free(slab);
+  }
+  pool->free = NULL;
+}
+
+struct pkt *pktalloc(struct pktpool *pool)
+{
+  struct pktbuf *buf;
+
+  if (pool->free == NULL)
+    growpool(pool);
+  buf = pool->free;
+  pool->free = buf->next;
+  buf->refs = 1;
+  return &buf->packet;
+}
+
+struct pkt *pkthold(struct pkt *packet)
+{
+  bufof(packet)->refs++;
+  return packet;
+}
+
+void pktrelease(struct pktpool *pool, struct pkt *packet)
+{
+  struct pktbuf *buf = bufof(packet);
+
+  if (--buf->refs == 0) {
+    buf->next = pool->free;
+    pool->free = buf;
+  }
+}
+
+struct pkt *pktunshare(struct pktpool *pool, struct pkt *packet)
+{
+  struct pkt *copy;
+
+  if (bufof(packet)->refs == 1)
+    return packet;
+  copy = pktalloc(pool);
+  copypkt(copy, packet);
+  pktrelease(pool, packet);
+  return copy;
+}
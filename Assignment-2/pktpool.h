@@ -0,0 +1,46 @@
+/* Reference counted packet buffers.  A packet is built in a buffer from
+   the emulator's pool and passed on by reference: the sender keeps one in
+   its window, tolayer3() holds another while the packet is in flight, and
+   the receiver is handed the same buffer.  A buffer is only written while
+   it has a single reference; pktunshare() gives the writer a private copy
+   otherwise, so corrupting or re-acknowledging a packet never changes a
+   copy that is still held elsewhere.
+
+   A buffer only has room for the payload size the pool was reset for,
+   not for MAXPAYLOAD: the rest of packet.payload lies past its end. */
+
+struct pktbuf {
+  struct pktbuf *next;     /* next free buffer while on the freelist */
+  int refs;                /* references held, 0 while free */
+  struct pkt packet;       /* only the first payloadsize bytes of the payload exist */
+};
+
+struct pktslab;
+
+struct pktpool {
+  struct pktslab *slabs;   /* every slab allocated so far */
+  struct pktbuf *free;     /* buffers available for reuse */
+  int payloadsize;         /* bytes of payload each buffer holds */
+  size_t stride;           /* bytes of each buffer in a slab */
+};
+
+/* return every buffer to the pool, at the start of a run, for packets of
+   up to payloadsize bytes of payload.  The slabs are freed if they were
+   made for another size */
+extern void pktpoolreset(struct pktpool *, int payloadsize);
+
+/* release the memory of the pool, it can be used again */
+extern void pktpoolfree(struct pktpool *);
+
+/* a new packet with one reference, its contents are undefined */
+extern struct pkt *pktalloc(struct pktpool *);
+
+/* take another reference to a packet, returns the packet */
+extern struct pkt *pkthold(struct pkt *);
+
+/* drop a reference, the buffer is reused once the last one is gone */
+extern void pktrelease(struct pktpool *, struct pkt *);
+
+/* the packet itself if the caller holds the only reference, otherwise a
+   copy that replaces the caller's reference */
+extern struct pkt *pktunshare(struct pktpool *, struct pkt *);
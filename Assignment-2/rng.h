@@ -0,0 +1,84 @@
+/* Random number generation for the emulator: xoshiro256** (Blackman and
+   Vigna), seeded through splitmix64.  It is fast, has no hidden global
+   state and produces the same sequence on every platform.  Each source of
+   randomness in the emulator draws from its own stream; the streams are
+   non-overlapping 2^128 long subsequences of the same generator, so
+   changing how often one of them is used does not disturb the others. */
+
+#include <stdint.h>
+
+struct rng {
+  uint64_t s[4];
+};
+
+static inline uint64_t rngrotl(uint64_t x, int k)
+{
+  return (x << k) | (x >> (64 - k));
+}
+
+/* return the next 64 random bits */
+static inline uint64_t rngnext(struct rng *r)
+{
+  uint64_t *s = r->s;
+  uint64_t result = rngrotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rngrotl(s[3], 45);
+  return result;
+}
+
+/* return a double uniform in [0,1) with 53 bits of precision */
+static inline double rnguniform(struct rng *r)
+{
+  return (rngnext(r) >> 11) * 0x1.0p-53;
+}
+
+/* advance the generator by 2^128 steps, used to split off a new stream */
+static inline void rngjump(struct rng *r)
+{
+  static const uint64_t jump[] = { 0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                   0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+  uint64_t t[4] = { 0, 0, 0, 0 };
+  int i, b, k;
+
+  for (i=0; i<4; i++)
+    for (b=0; b<64; b++) {
+      if (jump[i] & (UINT64_C(1) << b))
+        for (k=0; k<4; k++)
+          t[k] ^= r->s[k];
+      rngnext(r);
+    }
+  for (k=0; k<4; k++)
+    r->s[k] = t[k];
+}
+
+/* seed the generator, expanding the seed with splitmix64 */
+static inline void rngseed(struct rng *r, uint64_t seed)
+{
+  uint64_t z;
+  int k;
+
+  for (k=0; k<4; k++) {
+    z = (seed += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    r->s[k] = z ^ (z >> 31);
+  }
+}
+
+/* seed n consecutive non-overlapping streams from one seed */
+static inline void rngseedstreams(struct rng *streams, int n, uint64_t seed)
+{
+  int i;
+
+  rngseed(&streams[0], seed);
+  for (i=1; i<n; i++) {
+    streams[i] = streams[i-1];
+    rngjump(&streams[i]);
+  }
+}
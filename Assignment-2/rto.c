@@ -0,0 +1,96 @@
+#include <stdbool.h>
+#include "emulator.h"
+#include "rto.h"
+
+/* Retransmission timeout estimation, shared by the GBN and Selective
+   Repeat engines.  The constants are the ones of RFC 6298. */
+
+#define RTTALPHA  0.125       /* gain of the smoothed round trip time */
+#define RTTBETA   0.25        /* gain of the round trip time variation */
+#define RTTK      4.0         /* weight of the variation in the timeout */
+
+static double clamp(double rto)
+{
+  if (rto < RTOMIN)
+    return RTOMIN;
+  if (rto > RTOMAX)
+    return RTOMAX;
+  return rto;
+}
+
+/* copy the estimator state into the statistics of the run */
+static void publish(struct rto *r)
+{
+  if (!r->report)
+    return;
+  r->stats->srtt = r->srtt;
+  r->stats->rttvar = r->rttvar;
+  r->stats->rto = r->rto;
+  r->stats->rtt_samples = r->samples;
+}
+
+void rtoinit(struct rto *r, struct emulator *emu, bool report)
+{
+  const struct params *params = getparams(emu);
+
+  r->stats = getstats(emu);
+  r->report = report;
+  r->adaptive = params->adaptiverto != 0;
+  r->fixed = params->rtt;
+  r->srtt = 0.0;
+  r->rttvar = 0.0;
+  r->rto = params->rtt;
+  r->samples = 0;
+  r->minrtt = -1.0;
+  publish(r);
+}
+
+double rtointerval(const struct rto *r)
+{
+  if (r->adaptive)
+    return r->rto;
+  return r->fixed;
+}
+
+void rtosample(struct rto *r, double rtt)
+{
+  double err;
+
+  if (r->samples == 0) {
+    r->srtt = rtt;
+    r->rttvar = rtt / 2.0;
+  }
+  else {
+    err = r->srtt - rtt;
+    if (err < 0.0)
+      err = -err;
+    r->rttvar = (1.0 - RTTBETA) * r->rttvar + RTTBETA * err;
+    r->srtt = (1.0 - RTTALPHA) * r->srtt + RTTALPHA * rtt;
+  }
+  r->samples++;
+  if (r->minrtt < 0.0 || rtt < r->minrtt)
+    r->minrtt = rtt;
+
+  /* a fresh sample also ends any backoff */
+  r->rto = clamp(r->srtt + RTTK * r->rttvar);
+  publish(r);
+}
+
+void rtoexpired(struct rto *r)
+{
+  r->stats->timeouts++;
+  if (r->adaptive) {
+    r->rto = clamp(2.0 * r->rto);
+    publish(r);
+  }
+}
+
+/* the round trip of a resent packet is ambiguous, so it is not sampled.
+   But an ACK that returns sooner than any round trip ever measured must
+   have been sent for the original transmission: that packet was never
+   lost, and the timeout that resent it was spurious */
+void rtoresentacked(struct rto *r, double elapsed)
+{
+  if (r->minrtt >= 0.0 && elapsed < r->minrtt)
+    r->stats->spurious_timeouts++;
+}
@@ -0,0 +1,35 @@
+/* retransmission timeout of one sender.  With a fixed timeout the timer
+   is always armed with the configured RTT.  With an adaptive timeout it
+   follows the smoothed round trip time and its variation (Jacobson), is
+   sampled only from packets that were never retransmitted (Karn), and is
+   doubled on every timeout until a new sample arrives. */
+struct rto {
+  struct stats *stats;     /* statistics of the current run */
+  bool report;             /* copy the estimator state into the statistics */
+  bool adaptive;           /* estimate the timeout rather than use the configured RTT */
+  double fixed;            /* the configured RTT, also the initial timeout */
+  double srtt;             /* smoothed round trip time */
+  double rttvar;           /* round trip time variation */
+  double rto;              /* current estimate of the timeout */
+  int samples;             /* round trips measured */
+  double minrtt;           /* shortest round trip sampled, -1 before the first sample */
+};
+
+#define RTOMIN   1.0          /* bounds of the adaptive timeout */
+#define RTOMAX   128.0
+
+/* every sender counts its timeouts in the statistics of the run, the one
+   initialised with report true also leaves its estimator state there */
+extern void rtoinit(struct rto *, struct emulator *, bool);
+
+/* current timeout to arm the timer with */
+extern double rtointerval(const struct rto *);
+
+/* round trip time measured for a packet sent once */
+extern void rtosample(struct rto *, double);
+
+/* the timer expired and packets are being resent */
+extern void rtoexpired(struct rto *);
+
+/* a retransmitted packet was acknowledged, elapsed time after it was last sent */
+extern void rtoresentacked(struct rto *, double);
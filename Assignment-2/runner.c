@@ -0,0 +1,1096 @@
+/* ******************************************************************
+   Driver for the network emulator.
+
+   Reads the simulation parameters, either interactively or from the
+   command line, and runs one simulation per combination of the swept
+   parameters and per replication.  Replications use consecutive seeds
+   and can be spread over a pool of threads, each of which owns one
+   emulator; the statistics of a set of replications are summarised with
+   confidence intervals after the individual runs.  With a warm-up, the
+   runs that only differ in loss and corruption share it instead, each
+   continuing from it in a process of its own.
+
+   Built by make emulator, and with -DINSTRUMENT in CFLAGS to print the
+   instrumentation of instrument.h with the statistics of each run.
+   ********************************************************************* */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "emulator.h"
+#include "trace.h"
+
+#define  TRACEBUFSIZE  65536  /* size of the trace output buffer */
+
+FILE *tracefile;                  /* trace sink, see trace.h */
+static const char *tracepath = NULL;  /* file for the trace, NULL for stdout */
+static const char *recordpath = NULL; /* binary event log to record the run to */
+static const char *replaypath = NULL; /* binary event log to replay instead of simulating */
+static const char *cwndpath = NULL;   /* text log of the congestion windows of the run */
+static const char *sourcepath = NULL; /* arrival trace of the runs, see source.h */
+
+/* parameters of every run, may be changed on the command line */
+static struct params defaults = {
+  1000,         /* messages */
+  0.0,          /* loss probability */
+  0.0,          /* corruption probability */
+  2,            /* corruption/loss direction, A<->B */
+  10.0,         /* average time between messages */
+  9999,         /* seed */
+  6,            /* window size */
+  0,            /* sequence space, windowsize + 1 for GBN, 2 * windowsize for SR */
+  16.0,         /* RTT, MUST BE 16.0 when submitting assignment */
+  0,            /* fixed retransmission timeout */
+  3,            /* duplicate ACKs that trigger a fast retransmit */
+  0,            /* no sender queue, drop messages while the window is full */
+  1,            /* acknowledge every packet */
+  4.0,          /* longest delay of an ACK */
+  BIDIRECTIONAL, /* messages only from A to B */
+  PROTO_DEFAULT, /* protocol engine */
+  CHECKSUM_DEFAULT, /* packet checksum */
+  20,           /* bytes of data per message */
+  1,            /* connections */
+  0.0,          /* no link, the original channel delays */
+  0,            /* link rate in packets */
+  1.0,          /* propagation delay */
+  64,           /* packets the link holds */
+  0,            /* tail drop only */
+  0,            /* no congestion control */
+  ARRIVAL_UNIFORM, /* the original arrivals */
+  100.0,        /* mean on period */
+  100.0,        /* mean off period */
+  0,            /* generated payloads */
+  0.0           /* run every message */
+};
+
+static const char *const protocolnames[] = { "gbn", "sr" };
+static const char *const checksumnames[] = { "sum", "inet", "crc32c" };
+static const char *const arrivalnames[] = { "uniform", "poisson", "onoff", "saturate", "trace" };
+#define  NARRIVALS  (int)(sizeof(arrivalnames) / sizeof(arrivalnames[0]))
+
+/* formats of the results */
+#define  FORMAT_TEXT  0       /* the statistics of each run and the summaries */
+#define  FORMAT_JSON  1       /* one JSON object per run, one per line */
+#define  FORMAT_CSV   2       /* a header line, then one line per run */
+
+static const char *const formatnames[] = { "text", "json", "csv" };
+static int format = FORMAT_TEXT;
+
+/* values of the swept parameters.  Each of loss, corruption and lambda may
+   be given as a comma separated list on the command line; the emulator
+   then runs every combination in turn within the same process */
+#define  MAXSWEEP  64
+
+static float losslist[MAXSWEEP] = { 0.0 };
+static float corruptlist[MAXSWEEP] = { 0.0 };
+static float lambdalist[MAXSWEEP] = { 10.0 };
+static int nlosses = 1, ncorrupts = 1, nlambdas = 1;
+
+#define  MAXTHREADS  256
+
+static int replications = 1;      /* runs per sweep point, with seeds seed, seed+1, ... */
+static int nthreads = 1;          /* number of worker threads */
+static double warmup = -1.0;      /* simulated time the sweep of loss and corruption
+                                     branches at, negative for none */
+
+/* one simulation to run */
+struct job {
+  struct params params;
+  struct stats stats;
+};
+
+static struct job *jobs;
+static int njobs;
+static int nextjob;               /* first job not yet taken by a worker */
+static pthread_mutex_t joblock = PTHREAD_MUTEX_INITIALIZER;
+
+/* open the trace sink.  It is fully buffered with a large buffer, so a
+   verbose trace costs one write per TRACEBUFSIZE bytes instead of one per
+   line.  When the trace shares stdout with the prompts and statistics, this
+   must be called before anything is printed, and prompts are flushed
+   explicitly */
+void traceinit(const char *path)
+{
+  if (path == NULL)
+    tracefile = stdout;
+  else if ((tracefile = fopen(path, "w")) == NULL) {
+    printf("unable to open trace file %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  setvbuf(tracefile, NULL, _IOFBF, TRACEBUFSIZE);
+}
+
+void traceclose(void)
+{
+  fflush(tracefile);
+  if (tracefile != stdout)
+    fclose(tracefile);
+}
+
+void readparams(struct params *p)       /* prompt for the simulation parameters */
+{
+  printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
+  printf("Enter the number of messages to simulate: ");
+  fflush(stdout);
+  scanf("%d",&p->nsimmax);
+  printf("Enter  packet loss probability [enter 0.0 for no loss]:");
+  fflush(stdout);
+  scanf("%f",&p->lossprob);
+  printf("Enter packet corruption probability [0.0 for no corruption]:");
+  fflush(stdout);
+  scanf("%f",&p->corruptprob);
+  if (p->lossprob != 0.0 || p->corruptprob != 0.0) {
+    printf("If you want loss or corruption to only occur in one direction, choose the direction: 0 A->B, 1 A<-B, 2 A<->B (both directions) :");
+    fflush(stdout);
+    scanf("%d",&p->corruptdirection);
+  }
+  printf("Enter average time between messages from sender's layer5 [ > 0.0]:");
+  fflush(stdout);
+  scanf("%f",&p->lambda);
+  printf("Enter TRACE:");
+  fflush(stdout);
+  scanf("%d",&TRACE);
+}
+
+void usage(const char *prog)
+{
+  printf("usage: %s [options]\n", prog);
+  printf("  with no options the parameters are read interactively\n");
+  printf("  -n, --messages N     number of messages to simulate\n");
+  printf("  -l, --loss P[,P..]   packet loss probability\n");
+  printf("  -c, --corrupt P[,P..] packet corruption probability\n");
+  printf("  -d, --direction D    loss/corruption direction: 0 A->B, 1 A<-B, 2 A<->B\n");
+  printf("  -a, --lambda T[,T..] average time between messages from layer5\n");
+  printf("  -t, --trace N        TRACE level\n");
+  printf("  -o, --trace-file F   write the trace to file F instead of stdout\n");
+  printf("  -s, --seed N         random number generator seed\n");
+  printf("  -w, --window N       sender window size\n");
+  printf("  -S, --seqspace N     number of sequence numbers, default and minimum\n");
+  printf("                       windowsize + 1 for gbn, 2 * windowsize for sr,\n");
+  printf("                       at most 999998, 16974 with --checksum inet\n");
+  printf("  -r, --rtt T          retransmission timeout\n");
+  printf("  -A, --adaptive-rto   estimate the timeout from the round trip time,\n");
+  printf("                       starting from the RTT\n");
+  printf("  -D, --dupacks N      gbn sender fast retransmits on N duplicate ACKs,\n");
+  printf("                       0 never\n");
+  printf("  -q, --queue N        queue up to N messages while the window is full,\n");
+  printf("                       'unbounded' for no limit, 0 drops them\n");
+  printf("  -k, --ack-every K    gbn receiver acknowledges K packets at a time\n");
+  printf("  -K, --ack-delay T    longest time the gbn receiver holds back an ACK,\n");
+  printf("                       default 4\n");
+  printf("  -b, --bidirectional  gbn sends messages both ways, with piggybacked ACKs\n");
+  printf("                       that wait up to the ACK delay for a data packet\n");
+  printf("  -P, --protocol NAME  protocol engine: gbn (Go Back N) or sr (Selective Repeat)\n");
+  printf("  -p, --payload BYTES  data in each message, 1 to %d, default 20; each\n", MAXPAYLOAD);
+  printf("                       packet buffer takes about 28 bytes more\n");
+  printf("  -N, --connections N  sender/receiver pairs sharing the network, messages\n");
+  printf("                       arrive for a connection picked at random\n");
+  printf("  -L, --link-rate R    send packets over a link of R packets per time unit,\n");
+  printf("                       with a FIFO queue, instead of the original delays\n");
+  printf("  -B, --link-bytes     the link rate is in bytes, of the %d byte header and\n",
+         (int)offsetof(struct pkt, payload));
+  printf("                       the payload\n");
+  printf("  -g, --prop-delay T   propagation delay of the link, default 1\n");
+  printf("  -Q, --link-buffer N  packets the link holds, including the one being sent,\n");
+  printf("                       default 64, 'unbounded' for no limit\n");
+  printf("  -X, --red            drop early with RED before the link buffer is full\n");
+  printf("  -T, --arrivals NAME  messages from layer5: uniform (the original), poisson,\n");
+  printf("                       onoff (poisson in on periods only), saturate (one\n");
+  printf("                       whenever the window has room) or trace (see -f)\n");
+  printf("  -U, --on-time T      mean length of the on periods of onoff, default 100\n");
+  printf("  -V, --off-time T     mean length of the off periods of onoff, default 100\n");
+  printf("  -f, --source FILE    arrival times for trace, one per line, each optionally\n");
+  printf("                       followed by a space and the payload of the message\n");
+  printf("  -Y, --source-payload take the payloads of the messages from the trace\n");
+  printf("  -z, --congestion     gbn limits its senders by an AIMD congestion window\n");
+  printf("  -Z, --cwnd-log FILE  write every change of a congestion window to FILE\n");
+  printf("  -I, --precision REL  stop once the 95%% confidence intervals of the steady\n");
+  printf("                       state goodput and latency are within REL of their\n");
+  printf("                       means, e.g. 0.01, found by batch means after the\n");
+  printf("                       warm-up detected by MSER\n");
+  printf("  -C, --checksum NAME  packet checksum: sum, inet (Internet checksum)\n");
+  printf("                       or crc32c\n");
+  printf("  -F, --format NAME    results as text, json (one object per run) or csv,\n");
+  printf("                       without the summaries of replications\n");
+  printf("  -e, --record FILE    record the events of the run to a binary log\n");
+  printf("  -E, --replay FILE    run the protocol on the events of a recorded log,\n");
+  printf("                       with its parameters, and check what it sends\n");
+  printf("  -R, --replications N runs per parameter combination, seeds N, N+1, ...\n");
+  printf("  -j, --threads N      run simulations on N threads\n");
+  printf("  -W, --warmup T       simulate up to time T once for all the loss and\n");
+  printf("                       corruption values, with the first of each, then\n");
+  printf("                       continue each run from there in a forked process,\n");
+  printf("                       N at a time with -j N\n");
+  printf("  -h, --help           print this message\n");
+  printf("a comma separated list of loss, corruption or lambda values runs\n");
+  printf("every combination of them, one simulation after another.  With more\n");
+  printf("than one thread the traces of concurrent runs are interleaved\n");
+}
+
+/* the sequence space of a run, params.seqspace or the protocol's minimum */
+static int seqspaceof(const struct params *p)
+{
+  if (p->seqspace != 0)
+    return p->seqspace;
+  return p->protocol == PROTO_SR ? 2 * p->windowsize : p->windowsize + 1;
+}
+
+static void badarg(const char *prog, const char *opt, const char *value)
+{
+  printf("%s: invalid value '%s' for %s\n", prog, value, opt);
+  usage(prog);
+  exit(EXIT_FAILURE);
+}
+
+static double parsenum(const char *prog, const char *opt, const char *value,
+                       double min, double max)
+{
+  char *end;
+  double x;
+
+  x = strtod(value, &end);
+  if (end == value || *end != '\0' || x < min || x > max)
+    badarg(prog, opt, value);
+  return x;
+}
+
+/* parse a comma separated list of values into list, returning its length */
+static int parselist(const char *prog, const char *opt, const char *value,
+                     float *list, double min, double max)
+{
+  char field[64];
+  const char *p, *comma;
+  size_t len;
+  int n = 0;
+
+  for (p = value; ; p = comma + 1) {
+    comma = strchr(p, ',');
+    len = (comma != NULL) ? (size_t)(comma - p) : strlen(p);
+    if (n == MAXSWEEP || len == 0 || len >= sizeof(field))
+      badarg(prog, opt, value);
+    memcpy(field, p, len);
+    field[len] = '\0';
+    list[n++] = parsenum(prog, opt, field, min, max);
+    if (comma == NULL)
+      return n;
+  }
+}
+
+void parseargs(int argc, char **argv)   /* read the parameters from argv */
+{
+  static const struct option options[] = {
+    { "messages",  required_argument, NULL, 'n' },
+    { "loss",      required_argument, NULL, 'l' },
+    { "corrupt",   required_argument, NULL, 'c' },
+    { "direction", required_argument, NULL, 'd' },
+    { "lambda",    required_argument, NULL, 'a' },
+    { "trace",     required_argument, NULL, 't' },
+    { "trace-file", required_argument, NULL, 'o' },
+    { "seed",      required_argument, NULL, 's' },
+    { "window",    required_argument, NULL, 'w' },
+    { "seqspace",  required_argument, NULL, 'S' },
+    { "rtt",       required_argument, NULL, 'r' },
+    { "adaptive-rto", no_argument,    NULL, 'A' },
+    { "dupacks",   required_argument, NULL, 'D' },
+    { "queue",     required_argument, NULL, 'q' },
+    { "ack-every", required_argument, NULL, 'k' },
+    { "ack-delay", required_argument, NULL, 'K' },
+    { "bidirectional", no_argument,   NULL, 'b' },
+    { "protocol",  required_argument, NULL, 'P' },
+    { "payload",   required_argument, NULL, 'p' },
+    { "connections", required_argument, NULL, 'N' },
+    { "link-rate", required_argument, NULL, 'L' },
+    { "link-bytes", no_argument,      NULL, 'B' },
+    { "prop-delay", required_argument, NULL, 'g' },
+    { "link-buffer", required_argument, NULL, 'Q' },
+    { "red",       no_argument,       NULL, 'X' },
+    { "arrivals",  required_argument, NULL, 'T' },
+    { "on-time",   required_argument, NULL, 'U' },
+    { "off-time",  required_argument, NULL, 'V' },
+    { "source",    required_argument, NULL, 'f' },
+    { "source-payload", no_argument,  NULL, 'Y' },
+    { "congestion", no_argument,      NULL, 'z' },
+    { "cwnd-log",  required_argument, NULL, 'Z' },
+    { "precision", required_argument, NULL, 'I' },
+    { "checksum",  required_argument, NULL, 'C' },
+    { "format",    required_argument, NULL, 'F' },
+    { "record",    required_argument, NULL, 'e' },
+    { "replay",    required_argument, NULL, 'E' },
+    { "replications", required_argument, NULL, 'R' },
+    { "threads",   required_argument, NULL, 'j' },
+    { "warmup",    required_argument, NULL, 'W' },
+    { "help",      no_argument,       NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+  const char *seqarg = NULL;
+  const char *gbnarg = NULL;   /* the last option given that only gbn implements */
+  int c, i;
+
+  while ((c = getopt_long(argc, argv, "n:l:c:d:a:t:o:s:w:S:r:AD:q:k:K:bP:p:N:L:Bg:Q:XT:U:V:f:YzZ:I:C:F:e:E:R:j:W:h", options, NULL)) != -1) {
+    switch (c) {
+    case 'n':
+      defaults.nsimmax = parsenum(argv[0], "--messages", optarg, 0, 1e9);
+      break;
+    case 'l':
+      nlosses = parselist(argv[0], "--loss", optarg, losslist, 0.0, 1.0);
+      break;
+    case 'c':
+      ncorrupts = parselist(argv[0], "--corrupt", optarg, corruptlist, 0.0, 1.0);
+      break;
+    case 'd':
+      defaults.corruptdirection = parsenum(argv[0], "--direction", optarg, 0, 2);
+      break;
+    case 'a':
+      nlambdas = parselist(argv[0], "--lambda", optarg, lambdalist, 1e-9, 1e9);
+      break;
+    case 't':
+      TRACE = parsenum(argv[0], "--trace", optarg, 0, 100);
+      break;
+    case 'o':
+      tracepath = optarg;
+      break;
+    case 's':
+      defaults.seed = parsenum(argv[0], "--seed", optarg, 0, 4294967295.0);
+      break;
+    case 'w':
+      defaults.windowsize = parsenum(argv[0], "--window", optarg, 1, 1e6);
+      break;
+    case 'S':
+      seqarg = optarg;
+      defaults.seqspace = parsenum(argv[0], "--seqspace", optarg, 1, MAXSEQSPACE);
+      break;
+    case 'r':
+      defaults.rtt = parsenum(argv[0], "--rtt", optarg, 1e-9, 1e9);
+      break;
+    case 'A':
+      defaults.adaptiverto = 1;
+      break;
+    case 'D':
+      defaults.dupthreshold = parsenum(argv[0], "--dupacks", optarg, 0, 1e9);
+      gbnarg = "--dupacks";
+      break;
+    case 'q':
+      if (strcmp(optarg, "unbounded") == 0)
+        defaults.queuelimit = QUEUEUNBOUNDED;
+      else
+        defaults.queuelimit = parsenum(argv[0], "--queue", optarg, 0, 1e9);
+      break;
+    case 'k':
+      defaults.ackevery = parsenum(argv[0], "--ack-every", optarg, 1, 1e9);
+      gbnarg = "--ack-every";
+      break;
+    case 'K':
+      defaults.ackdelay = parsenum(argv[0], "--ack-delay", optarg, 1e-9, 1e9);
+      gbnarg = "--ack-delay";
+      break;
+    case 'b':
+      defaults.bidirectional = 1;
+      break;
+    case 'P':
+      if (strcmp(optarg, protocolnames[PROTO_GBN]) == 0)
+        defaults.protocol = PROTO_GBN;
+      else if (strcmp(optarg, protocolnames[PROTO_SR]) == 0)
+        defaults.protocol = PROTO_SR;
+      else
+        badarg(argv[0], "--protocol", optarg);
+      break;
+    case 'p':
+      defaults.payloadsize = parsenum(argv[0], "--payload", optarg, 1, MAXPAYLOAD);
+      break;
+    case 'N':
+      defaults.connections = parsenum(argv[0], "--connections", optarg, 1, 1e6);
+      break;
+    case 'L':
+      defaults.linkrate = parsenum(argv[0], "--link-rate", optarg, 1e-9, 1e9);
+      break;
+    case 'B':
+      defaults.linkbytes = 1;
+      break;
+    case 'g':
+      defaults.propdelay = parsenum(argv[0], "--prop-delay", optarg, 0, 1e9);
+      break;
+    case 'Q':
+      if (strcmp(optarg, "unbounded") == 0)
+        defaults.linkbuffer = QUEUEUNBOUNDED;
+      else
+        defaults.linkbuffer = parsenum(argv[0], "--link-buffer", optarg, 1, 1e9);
+      break;
+    case 'X':
+      defaults.red = 1;
+      break;
+    case 'T':
+      for (i=0; i<NARRIVALS && strcmp(optarg, arrivalnames[i]) != 0; i++)
+        ;
+      if (i == NARRIVALS)
+        badarg(argv[0], "--arrivals", optarg);
+      defaults.arrivals = i;
+      break;
+    case 'U':
+      defaults.ontime = parsenum(argv[0], "--on-time", optarg, 1e-9, 1e9);
+      break;
+    case 'V':
+      defaults.offtime = parsenum(argv[0], "--off-time", optarg, 0, 1e9);
+      break;
+    case 'f':
+      sourcepath = optarg;
+      break;
+    case 'Y':
+      defaults.sourcepayload = 1;
+      break;
+    case 'z':
+      defaults.congestion = 1;
+      break;
+    case 'Z':
+      cwndpath = optarg;
+      break;
+    case 'I':
+      defaults.precision = parsenum(argv[0], "--precision", optarg, 1e-9, 1.0);
+      break;
+    case 'C':
+      if (strcmp(optarg, checksumnames[CHECKSUM_SUM]) == 0)
+        defaults.checksum = CHECKSUM_SUM;
+      else if (strcmp(optarg, checksumnames[CHECKSUM_INET]) == 0)
+        defaults.checksum = CHECKSUM_INET;
+      else if (strcmp(optarg, checksumnames[CHECKSUM_CRC32C]) == 0)
+        defaults.checksum = CHECKSUM_CRC32C;
+      else
+        badarg(argv[0], "--checksum", optarg);
+      break;
+    case 'F':
+      if (strcmp(optarg, formatnames[FORMAT_TEXT]) == 0)
+        format = FORMAT_TEXT;
+      else if (strcmp(optarg, formatnames[FORMAT_JSON]) == 0)
+        format = FORMAT_JSON;
+      else if (strcmp(optarg, formatnames[FORMAT_CSV]) == 0)
+        format = FORMAT_CSV;
+      else
+        badarg(argv[0], "--format", optarg);
+      break;
+    case 'e':
+      recordpath = optarg;
+      break;
+    case 'E':
+      replaypath = optarg;
+      break;
+    case 'R':
+      replications = parsenum(argv[0], "--replications", optarg, 1, 1e6);
+      break;
+    case 'j':
+      nthreads = parsenum(argv[0], "--threads", optarg, 1, MAXTHREADS);
+      break;
+    case 'W':
+      warmup = parsenum(argv[0], "--warmup", optarg, 0, 1e12);
+      break;
+    case 'h':
+      usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    default:
+      usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (optind < argc)
+    badarg(argv[0], "argument", argv[optind]);
+
+  /* the sequence space must tell apart every packet the window can hold */
+  if (seqarg != NULL &&
+      ((defaults.protocol == PROTO_GBN && defaults.seqspace < defaults.windowsize + 1) ||
+       (defaults.protocol == PROTO_SR && defaults.seqspace < 2 * defaults.windowsize)))
+    badarg(argv[0], "--seqspace", seqarg);
+  if (seqspaceof(&defaults) > MAXSEQSPACE) {
+    printf("%s: --window needs a sequence space over %d\n", argv[0], MAXSEQSPACE);
+    exit(EXIT_FAILURE);
+  }
+  if (defaults.checksum == CHECKSUM_INET && seqspaceof(&defaults) > INETMAXSEQSPACE) {
+    printf("%s: --checksum inet needs a sequence space of at most %d\n", argv[0],
+           INETMAXSEQSPACE);
+    exit(EXIT_FAILURE);
+  }
+
+  if (defaults.red && defaults.linkbuffer == QUEUEUNBOUNDED) {
+    printf("%s: --red needs a bounded --link-buffer\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  if (defaults.bidirectional && defaults.protocol != PROTO_GBN) {
+    printf("%s: --bidirectional is only supported by gbn\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (gbnarg != NULL && defaults.protocol != PROTO_GBN) {
+    printf("%s: %s is only supported by gbn\n", argv[0], gbnarg);
+    exit(EXIT_FAILURE);
+  }
+
+  if (defaults.arrivals == ARRIVAL_TRACE && sourcepath == NULL && replaypath == NULL) {
+    printf("%s: --arrivals trace needs an arrival trace, --source FILE\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (defaults.sourcepayload && defaults.arrivals != ARRIVAL_TRACE) {
+    printf("%s: --source-payload needs --arrivals trace\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  if (defaults.congestion && defaults.protocol != PROTO_GBN) {
+    printf("%s: --congestion is only supported by gbn\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  /* a log holds one run */
+  if ((recordpath != NULL || replaypath != NULL) &&
+      nlosses * ncorrupts * nlambdas * replications * nthreads > 1) {
+    printf("%s: --record and --replay take a single run on one thread\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (cwndpath != NULL && nlosses * ncorrupts * nlambdas * replications * nthreads > 1) {
+    printf("%s: --cwnd-log takes a single run on one thread\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (warmup >= 0.0 && (recordpath != NULL || replaypath != NULL || cwndpath != NULL)) {
+    printf("%s: --warmup cannot be combined with --record, --replay or --cwnd-log\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (recordpath != NULL && replaypath != NULL) {
+    printf("%s: --record and --replay cannot be combined\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* build the list of jobs: every sweep point, replications times each */
+static void makejobs(void)
+{
+  struct params *p;
+  int i, j, k, r, n = 0;
+
+  njobs = nlosses * ncorrupts * nlambdas * replications;
+  jobs = calloc(njobs, sizeof(struct job));
+  if (jobs == NULL) {
+    printf("memory allocation for jobs failed.");
+    exit(EXIT_FAILURE);
+  }
+  for (i=0; i<nlosses; i++)
+    for (j=0; j<ncorrupts; j++)
+      for (k=0; k<nlambdas; k++)
+        for (r=0; r<replications; r++) {
+          p = &jobs[n++].params;
+          *p = defaults;
+          p->lossprob = losslist[i];
+          p->corruptprob = corruptlist[j];
+          p->lambda = lambdalist[k];
+          p->seed = defaults.seed + r;
+        }
+}
+
+static void *worker(void *arg)
+{
+  struct emulator *emu;
+  int i;
+
+  (void)arg;
+  emu = newemulator();
+  sourceemulator(emu, sourcepath);
+  for (;;) {
+    pthread_mutex_lock(&joblock);
+    i = nextjob++;
+    pthread_mutex_unlock(&joblock);
+    if (i >= njobs)
+      break;
+    runemulator(emu, &jobs[i].params, &jobs[i].stats);
+  }
+  freeemulator(emu);
+  return NULL;
+}
+
+static void runparallel(void)
+{
+  pthread_t threads[MAXTHREADS];
+  int i;
+
+  for (i=0; i<nthreads; i++)
+    if (pthread_create(&threads[i], NULL, worker, NULL) != 0) {
+      printf("unable to create thread\n");
+      exit(EXIT_FAILURE);
+    }
+  for (i=0; i<nthreads; i++)
+    pthread_join(threads[i], NULL);
+}
+
+/* index in jobs of a sweep point and replication, as laid out by makejobs() */
+static int jobindex(int loss, int corrupt, int lambda, int replication)
+{
+  return ((loss * ncorrupts + corrupt) * nlambdas + lambda) * replications + replication;
+}
+
+/* wait for a branch to finish */
+static void waitbranch(void)
+{
+  int status;
+
+  if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    printf("a run branched from the warm-up failed\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* the runs of each lambda and replication share one warm-up, simulated
+   with the first loss and corruption.  Each run then continues from it in
+   a child process, which inherits a copy of the emulator as it was at the
+   end of the warm-up, and leaves its statistics in memory shared with the
+   parent.  The run branched with the first loss and corruption is the
+   same as one simulated from the start */
+static void runbranched(void)
+{
+  struct emulator *emu;
+  struct stats *results;
+  int running = 0;
+  int i, j, k, r, n;
+  pid_t pid;
+
+  results = mmap(NULL, njobs * sizeof(struct stats), PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (results == MAP_FAILED) {
+    printf("memory allocation for results failed.");
+    exit(EXIT_FAILURE);
+  }
+  emu = newemulator();
+  sourceemulator(emu, sourcepath);
+  for (k=0; k<nlambdas; k++)
+    for (r=0; r<replications; r++) {
+      startemulator(emu, &jobs[jobindex(0, 0, k, r)].params);
+      advanceemulator(emu, warmup);
+
+      /* the children would write out what is buffered again */
+      fflush(stdout);
+      fflush(tracefile);
+      for (i=0; i<nlosses; i++)
+        for (j=0; j<ncorrupts; j++) {
+          if (running == nthreads) {
+            waitbranch();
+            running--;
+          }
+          n = jobindex(i, j, k, r);
+          if ((pid = fork()) < 0) {
+            printf("unable to start a process\n");
+            exit(EXIT_FAILURE);
+          }
+          if (pid == 0) {
+            branchemulator(emu, losslist[i], corruptlist[j]);
+            finishemulator(emu, &results[n]);
+            /* _exit() leaves stdio buffers unwritten */
+            fflush(stdout);
+            fflush(tracefile);
+            _exit(EXIT_SUCCESS);
+          }
+          running++;
+        }
+    }
+  while (running-- > 0)
+    waitbranch();
+  freeemulator(emu);
+
+  for (n=0; n<njobs; n++)
+    jobs[n].stats = results[n];
+  munmap(results, njobs * sizeof(struct stats));
+}
+
+static void printparams(const struct params *p)
+{
+  printf("messages: %d loss: %f corrupt: %f direction: %d lambda: %f seed: %u window: %d rtt: %f rto: %s protocol: %s checksum: %s payload: %d connections: %d",
+         p->nsimmax, p->lossprob, p->corruptprob, p->corruptdirection, p->lambda,
+         p->seed, p->windowsize, p->rtt, p->adaptiverto ? "adaptive" : "fixed",
+         protocolnames[p->protocol], checksumnames[p->checksum], p->payloadsize,
+         p->connections);
+  if (p->linkrate > 0.0)
+    printf(" link: %f %s prop: %f buffer: %d queue: %s", p->linkrate,
+           p->linkbytes ? "bytes" : "packets", p->propdelay, p->linkbuffer,
+           p->red ? "red" : "tail-drop");
+  if (p->arrivals != ARRIVAL_UNIFORM)
+    printf(" arrivals: %s", arrivalnames[p->arrivals]);
+  if (p->arrivals == ARRIVAL_ONOFF)
+    printf(" on: %f off: %f", p->ontime, p->offtime);
+  if (p->arrivals == ARRIVAL_TRACE && p->sourcepayload)
+    printf(" payloads: trace");
+  if (p->congestion)
+    printf(" congestion: aimd");
+  if (warmup >= 0.0)
+    printf(" warmup: %f", warmup);
+  printf("\n");
+}
+
+/* messages delivered per unit of simulated time */
+static double goodput(const struct stats *s)
+{
+  return s->time > 0.0 ? s->messages_delivered / s->time : 0.0;
+}
+
+/* fraction of the run during which the medium towards A or B held a packet */
+static double utilization(const struct stats *s, int towards)
+{
+  return s->time > 0.0 ? s->channelbusy[towards] / s->time : 0.0;
+}
+
+/* retransmissions per data packet sent */
+static double retransmissionratio(const struct stats *s)
+{
+  return s->packets_sent > 0 ? (double)s->packets_resent / s->packets_sent : 0.0;
+}
+
+/* the instrumentation of a run, see instrument.h */
+static void printinstrument(const struct instrument *in)
+{
+  static const char *const callbacks[NEVTYPES] = { "timerinterrupt", "output", "input" };
+  long dispatched = in->dispatched[0] + in->dispatched[1] + in->dispatched[2];
+  int i, j;
+
+  printf("events dispatched: timerinterrupt %ld fromlayer5 %ld fromlayer3 %ld \n",
+         in->dispatched[0], in->dispatched[1], in->dispatched[2]);
+  printf("event list length: max %d mean %f \n", in->evlistmax,
+         dispatched > 0 ? in->evlistsum / dispatched : 0.0);
+  printf("timers: started %d restarted %d stopped %d, warnings: already started %d not running %d \n",
+         in->timerstarts, in->timerrestarts, in->timerstops, in->alreadystarted, in->notrunning);
+  for (i=A; i<=B; i++)
+    for (j=0; j<NEVTYPES; j++)
+      if (in->calls[i][j] > 0)
+        printf("%c_%s: %ld calls, %f cycles per call \n", 'A' + i, callbacks[j],
+               in->calls[i][j], (double)in->cycles[i][j] / in->calls[i][j]);
+}
+
+/* the larger relative half width of the steady state confidence intervals */
+static double steadyprecision(const struct stats *s)
+{
+  const struct steadyestimate *e = &s->steady;
+
+  if (e->batches == 0 || e->goodput <= 0.0 || e->latency <= 0.0)
+    return 0.0;
+  return fmax(e->goodputhalf / e->goodput, e->latencyhalf / e->latency);
+}
+
+static void printsteady(const struct params *p, const struct stats *s)
+{
+  const struct steadyestimate *e = &s->steady;
+
+  if (e->batches == 0) {
+    printf(" too few messages after the warm-up for a steady state estimate\n");
+    return;
+  }
+  printf(" %s: steady state after time %f, from %d batches\n",
+         s->steady_converged ? "converged" : "not converged", e->warmupend, e->batches);
+  printf(" goodput %f +/- %f latency %f +/- %f, precision %f of %f\n", e->goodput,
+         e->goodputhalf, e->latency, e->latencyhalf, steadyprecision(s), p->precision);
+}
+
+static void printstats(const struct params *p, const struct stats *s)
+{
+  printf(" Simulator terminated at time %f\n after attempting to send %d msgs from layer5\n",s->time,s->nsim);
+  if (p->precision > 0.0)
+    printsteady(p, s);
+  printf("number of messages dropped due to full window:  %d \n", s->window_full);
+  printf("number of messages queued due to full window:  %d \n", s->messages_queued);
+  printf("queueing delay at A: mean %f p99 %f \n",
+         histmean(&s->queuedelay), histquantile(&s->queuedelay, 0.99));
+  printf("number of valid (not corrupt or duplicate) acknowledgements received at A:  %d \n", s->new_ACKs);
+  printf("(note: a single acknowledgement may have acknowledged more than one packet - if cumulative acknowledgements are used)\n");
+  printf("number of packet resends by A:  %d \n", s->packets_resent);
+  printf("number of fast retransmits by A:  %d \n", s->fast_retransmits);
+  printf("number of correct packets received at B:  %d \n", s->packets_received);
+  printf("number of ACKs suppressed by B:  %d \n", s->acks_suppressed);
+  printf("number of ACK-only packets sent:  %d \n", s->acks_sent);
+  printf("number of ACKs piggybacked on data packets:  %d \n", s->acks_piggybacked);
+  printf("number of messages delivered to application:  %d \n", s->messages_delivered);
+  printf("number of retransmission timeouts at A:  %d \n", s->timeouts);
+  printf("number of spurious timeouts at A:  %d \n", s->spurious_timeouts);
+  printf("round trip estimate at A: srtt %f rttvar %f rto %f from %d samples\n",
+         s->srtt, s->rttvar, s->rto, s->rtt_samples);
+  if (p->congestion)
+    printf("congestion window at A: cwnd %f ssthresh %f, cut %d times \n",
+           s->cwnd, s->ssthresh, s->cwnd_cuts);
+  printf("number of packets dropped by the link queue:  %d, early by RED %d \n",
+         s->nqueuedrop, s->nearlydrop);
+  printf("goodput: %f messages per time unit \n", goodput(s));
+  printf("utilization of the medium: A->B %f A<-B %f \n",
+         utilization(s, B), utilization(s, A));
+  printf("retransmission ratio:  %f \n", retransmissionratio(s));
+  printf("end to end latency: mean %f p50 %f p90 %f p99 %f \n",
+         histmean(&s->latency), histquantile(&s->latency, 0.5),
+         histquantile(&s->latency, 0.9), histquantile(&s->latency, 0.99));
+  if (replaypath != NULL)
+    printf("number of packets sent that differ from the log:  %d \n", s->replay_mismatches);
+  if (INSTRUMENTED)
+    printinstrument(&s->instr);
+}
+
+/* the statistics summarised over replications, and their keys in the
+   machine readable formats */
+#define  NSUMMARY  27
+
+static const char *const summarylabels[NSUMMARY] = {
+  "simulator terminated at time",
+  "number of messages dropped due to full window",
+  "number of messages queued due to full window",
+  "mean queueing delay at A",
+  "p99 queueing delay at A",
+  "number of valid (not corrupt or duplicate) acknowledgements received at A",
+  "number of packet resends by A",
+  "number of fast retransmits by A",
+  "number of correct packets received at B",
+  "number of ACKs suppressed by B",
+  "number of ACK-only packets sent",
+  "number of ACKs piggybacked on data packets",
+  "number of messages delivered to application",
+  "number of retransmission timeouts at A",
+  "number of spurious timeouts at A",
+  "number of data packets sent by A",
+  "number of packets dropped by the link queue",
+  "number of packets dropped early by RED",
+  "number of congestion window cuts",
+  "goodput in messages per time unit",
+  "utilization of the medium A->B",
+  "utilization of the medium A<-B",
+  "retransmission ratio",
+  "mean end to end latency",
+  "p50 end to end latency",
+  "p90 end to end latency",
+  "p99 end to end latency",
+};
+
+static const char *const summarykeys[NSUMMARY] = {
+  "time", "window_full", "messages_queued", "queue_delay_mean",
+  "queue_delay_p99", "new_acks", "packets_resent", "fast_retransmits",
+  "packets_received", "acks_suppressed", "acks_sent", "acks_piggybacked",
+  "messages_delivered", "timeouts", "spurious_timeouts", "packets_sent",
+  "queue_drops", "early_drops", "cwnd_cuts",
+  "goodput", "utilization_ab", "utilization_ba", "retransmission_ratio",
+  "latency_mean", "latency_p50", "latency_p90", "latency_p99",
+};
+
+static double summaryvalue(const struct stats *s, int which)
+{
+  switch (which) {
+  case 0:  return s->time;
+  case 1:  return s->window_full;
+  case 2:  return s->messages_queued;
+  case 3:  return histmean(&s->queuedelay);
+  case 4:  return histquantile(&s->queuedelay, 0.99);
+  case 5:  return s->new_ACKs;
+  case 6:  return s->packets_resent;
+  case 7:  return s->fast_retransmits;
+  case 8:  return s->packets_received;
+  case 9:  return s->acks_suppressed;
+  case 10: return s->acks_sent;
+  case 11: return s->acks_piggybacked;
+  case 12: return s->messages_delivered;
+  case 13: return s->timeouts;
+  case 14: return s->spurious_timeouts;
+  case 15: return s->packets_sent;
+  case 16: return s->nqueuedrop;
+  case 17: return s->nearlydrop;
+  case 18: return s->cwnd_cuts;
+  case 19: return goodput(s);
+  case 20: return utilization(s, B);
+  case 21: return utilization(s, A);
+  case 22: return retransmissionratio(s);
+  case 23: return histmean(&s->latency);
+  case 24: return histquantile(&s->latency, 0.5);
+  case 25: return histquantile(&s->latency, 0.9);
+  default: return histquantile(&s->latency, 0.99);
+  }
+}
+
+/* print mean and 95% confidence interval of the statistics of n replications */
+static void printsummary(const struct job *runs, int n)
+{
+  double x, sum, sumsq, mean, sd, half;
+  int i, k;
+
+  printf("summary of %d replications, mean +/- 95%% confidence interval:\n", n);
+  for (k=0; k<NSUMMARY; k++) {
+    sum = sumsq = 0.0;
+    for (i=0; i<n; i++) {
+      x = summaryvalue(&runs[i].stats, k);
+      sum += x;
+      sumsq += x * x;
+    }
+    mean = sum / n;
+    sd = sqrt(fmax(0.0, (sumsq - n * mean * mean) / (n - 1)));
+    half = tquantile(n - 1) * sd / sqrt(n);
+    printf("%s:  %f +/- %f \n", summarylabels[k], mean, half);
+  }
+}
+
+/* fields of one run in the machine readable formats */
+static int nfields;               /* fields printed so far in this record */
+static int csvheader;             /* print the keys of the fields instead */
+
+static void field(const char *key, const char *value)
+{
+  if (format == FORMAT_JSON)
+    printf("%s\"%s\": %s", nfields == 0 ? "{" : ", ", key, value);
+  else
+    printf("%s%s", nfields == 0 ? "" : ",", csvheader ? key : value);
+  nfields++;
+}
+
+static void numfield(const char *key, double x)
+{
+  char value[32];
+
+  snprintf(value, sizeof(value), "%.10g", x);
+  field(key, value);
+}
+
+/* a float parameter, to the digits a float holds */
+static void floatfield(const char *key, float x)
+{
+  char value[32];
+
+  snprintf(value, sizeof(value), "%.7g", x);
+  field(key, value);
+}
+
+/* the names used as values never need escaping */
+static void strfield(const char *key, const char *str)
+{
+  char value[32];
+
+  snprintf(value, sizeof(value), format == FORMAT_JSON ? "\"%s\"" : "%s", str);
+  field(key, value);
+}
+
+/* the parameters and statistics of a run as a JSON object or a CSV line */
+static void printrecord(const struct job *job)
+{
+  const struct params *p = &job->params;
+  int k;
+
+  nfields = 0;
+  numfield("messages", p->nsimmax);
+  floatfield("loss", p->lossprob);
+  floatfield("corrupt", p->corruptprob);
+  numfield("direction", p->corruptdirection);
+  floatfield("lambda", p->lambda);
+  numfield("seed", p->seed);
+  numfield("window", p->windowsize);
+  numfield("seqspace", seqspaceof(p));
+  numfield("rtt", p->rtt);
+  strfield("rto", p->adaptiverto ? "adaptive" : "fixed");
+  numfield("dupacks", p->dupthreshold);
+  numfield("queue", p->queuelimit);
+  numfield("ack_every", p->ackevery);
+  numfield("ack_delay", p->ackdelay);
+  numfield("bidirectional", p->bidirectional);
+  strfield("protocol", protocolnames[p->protocol]);
+  strfield("checksum", checksumnames[p->checksum]);
+  numfield("payload", p->payloadsize);
+  numfield("connections", p->connections);
+  numfield("link_rate", p->linkrate);
+  numfield("link_bytes", p->linkbytes);
+  numfield("prop_delay", p->propdelay);
+  numfield("link_buffer", p->linkbuffer);
+  numfield("red", p->red);
+  numfield("congestion", p->congestion);
+  strfield("arrivals", arrivalnames[p->arrivals]);
+  numfield("on_time", p->ontime);
+  numfield("off_time", p->offtime);
+  numfield("source_payload", p->sourcepayload);
+  if (warmup >= 0.0)
+    numfield("warmup", warmup);
+  for (k=0; k<NSUMMARY; k++)
+    numfield(summarykeys[k], summaryvalue(&job->stats, k));
+  if (p->precision > 0.0) {
+    numfield("precision", p->precision);
+    numfield("steady_converged", job->stats.steady_converged);
+    numfield("steady_start", job->stats.steady.warmupend);
+    numfield("steady_batches", job->stats.steady.batches);
+    numfield("steady_goodput", job->stats.steady.goodput);
+    numfield("steady_goodput_half", job->stats.steady.goodputhalf);
+    numfield("steady_latency", job->stats.steady.latency);
+    numfield("steady_latency_half", job->stats.steady.latencyhalf);
+    numfield("steady_precision", steadyprecision(&job->stats));
+  }
+  if (replaypath != NULL)
+    numfield("replay_mismatches", job->stats.replay_mismatches);
+  printf(format == FORMAT_JSON ? "}\n" : "\n");
+}
+
+int main(int argc, char **argv)
+{
+  struct emulator *emu = NULL;
+  struct stats stats;
+  int i;
+
+  if (argc == 1) {
+    traceinit(NULL);
+    readparams(&defaults);
+    emu = newemulator();
+    runemulator(emu, &defaults, &stats);
+    freeemulator(emu);
+    printstats(&defaults, &stats);
+    traceclose();
+    return EXIT_SUCCESS;
+  }
+
+  parseargs(argc, argv);
+  traceinit(tracepath);
+  makejobs();
+  if (format == FORMAT_TEXT)
+    printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
+  else if (format == FORMAT_CSV) {
+    csvheader = 1;
+    printrecord(&jobs[0]);
+    csvheader = 0;
+  }
+
+  /* branched runs come out of their warm-ups together, and the traces
+     of all of them come before the results.  A single thread runs the
+     jobs in order under the main thread, so the trace of each run
+     follows its parameters */
+  if (warmup >= 0.0)
+    runbranched();
+  else if (nthreads == 1) {
+    emu = newemulator();
+    recordemulator(emu, recordpath);
+    cwndlogemulator(emu, cwndpath);
+    sourceemulator(emu, sourcepath);
+  }
+  else
+    runparallel();
+
+  /* the parameters of a replay come from the log */
+  if (replaypath != NULL) {
+    replayemulator(emu, replaypath, &jobs[0].params, &jobs[0].stats);
+    if (format == FORMAT_TEXT) {
+      printparams(&jobs[0].params);
+      printstats(&jobs[0].params, &jobs[0].stats);
+    }
+    else
+      printrecord(&jobs[0]);
+    njobs = 0;
+  }
+  for (i=0; i<njobs; i++) {
+    if (format != FORMAT_TEXT) {
+      if (emu != NULL)
+        runemulator(emu, &jobs[i].params, &jobs[i].stats);
+      printrecord(&jobs[i]);
+      continue;
+    }
+    if (i > 0)
+      printf("\n");
+    printparams(&jobs[i].params);
+    if (emu != NULL)
+      runemulator(emu, &jobs[i].params, &jobs[i].stats);
+    printstats(&jobs[i].params, &jobs[i].stats);
+    if (replications > 1 && (i + 1) % replications == 0) {
+      printf("\n");
+      printsummary(&jobs[i + 1 - replications], replications);
+    }
+  }
+  if (emu != NULL)
+    freeemulator(emu);
+  free(jobs);
+  traceclose();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,30 @@
+/* Sequence space and window buffer arithmetic shared by the protocol
+   engines.  The window buffers are rings whose capacity is rounded up to a
+   power of two, so a slot index always wraps with a mask.  A sequence
+   space that is a power of two wraps with a mask too; any other size
+   falls back to a division. */
+
+/* smallest power of two that holds n entries */
+static inline int ringcapacity(int n)
+{
+  int capacity = 1;
+
+  while (capacity < n)
+    capacity <<= 1;
+  return capacity;
+}
+
+/* mask that reduces a sequence number into a space of the given size,
+   or 0 if the size is not a power of two */
+static inline int seqmaskof(int size)
+{
+  return (size & (size - 1)) == 0 ? size - 1 : 0;
+}
+
+/* x modulo the sequence space size, for x >= 0 */
+static inline int seqwrap(int x, int size, int mask)
+{
+  if (mask != 0)
+    return x & mask;
+  return x % size;
+}
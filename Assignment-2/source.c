@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "emulator.h"
+#include "source.h"
+
+/* Arrival traces, read by the emulator's trace driven source. */
+
+static void badline(const struct sourcereader *r, const char *what)
+{
+  printf("arrival trace %s, line %d: %s\n", r->path, r->line, what);
+  exit(EXIT_FAILURE);
+}
+
+void sourceopen(struct sourcereader *r, const char *path)
+{
+  struct stat st;
+  void *map = NULL;
+  int fd;
+
+  if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+    printf("unable to open arrival trace %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  r->size = st.st_size;
+  if (r->size > 0) {
+    map = mmap(NULL, r->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      printf("unable to map arrival trace %s\n", path);
+      exit(EXIT_FAILURE);
+    }
+    madvise(map, r->size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+  r->path = path;
+  r->map = map;
+  r->pos = 0;
+  r->line = 0;
+  r->last = 0.0;
+}
+
+int sourcenext(struct sourcereader *r, double *time, const char **payload, int *length)
+{
+  const char *p, *end, *eol, *nl;
+  char field[64];
+  char *fieldend;
+  size_t n;
+
+  while (r->pos < r->size) {
+    p = r->map + r->pos;
+    nl = memchr(p, '\n', r->size - r->pos);
+    eol = (nl != NULL) ? nl : r->map + r->size;
+    r->pos = eol - r->map + 1;
+    r->line++;
+    if (eol > p && eol[-1] == '\r')
+      eol--;
+
+    while (p < eol && (*p == ' ' || *p == '\t'))
+      p++;
+    if (p == eol || *p == '#')
+      continue;
+
+    /* the time, which is copied out since the map is not a string */
+    for (end = p; end < eol && *end != ' ' && *end != '\t'; end++)
+      ;
+    n = end - p;
+    if (n >= sizeof(field))
+      badline(r, "malformed time");
+    memcpy(field, p, n);
+    field[n] = '\0';
+    *time = strtod(field, &fieldend);
+    if (*fieldend != '\0' || !isfinite(*time) || *time < 0.0)
+      badline(r, "malformed time");
+    if (*time < r->last)
+      badline(r, "the arrival times decrease");
+    r->last = *time;
+
+    /* the payload is everything after the separator */
+    *payload = (end < eol) ? end + 1 : eol;
+    *length = eol - *payload;
+    if (*length > MAXPAYLOAD)
+      badline(r, "payload longer than MAXPAYLOAD");
+    return 1;
+  }
+  return 0;
+}
+
+void sourceunmap(struct sourcereader *r)
+{
+  if (r->map != NULL)
+    munmap((void *)r->map, r->size);
+  r->map = NULL;
+}
@@ -0,0 +1,26 @@
+/* Arrival traces.  A trace is a text file with one message per line: the
+   time it arrives from layer 5, and optionally, after a space or a tab,
+   its payload, which is the rest of the line.  The times are absolute and
+   must not decrease.  Blank lines and lines starting with '#' are
+   skipped.  The file is mapped into memory and read a line at a time, so
+   a trace of any length costs no more than the pages being read. */
+
+/* a trace being read */
+struct sourcereader {
+  const char *path;
+  const char *map;
+  size_t size;
+  size_t pos;              /* offset of the next line */
+  int line;                /* number of the line last read */
+  double last;             /* time of the arrival last read */
+};
+
+/* map the trace at path */
+extern void sourceopen(struct sourcereader *, const char *);
+
+/* read the next arrival: its time, and a pointer into the trace to its
+   payload and the payload's length, 0 if the line has none.  Returns 0 at
+   the end of the trace */
+extern int sourcenext(struct sourcereader *, double *, const char **, int *);
+
+extern void sourceunmap(struct sourcereader *);
@@ -0,0 +1,434 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "emulator.h"
+#include "trace.h"
+#include "checksum.h"
+#include "rto.h"
+#include "msgqueue.h"
+#include "pktpool.h"
+#include "seqspace.h"
+#include "ack.h"
+#include "sr.h"
+
+/* ******************************************************************
+   Selective Repeat protocol, running over the same emulator interface
+   as the Go Back N implementation in gbn.c.
+
+   - every packet in the sender window has its own logical timer.  The
+   emulator provides one timer per entity, so it is always armed for the
+   earliest deadline in the window, and a timeout resends only the
+   packets whose deadline has passed.
+   - the receiver buffers packets that arrive out of order within its
+   window and delivers them to layer 5 as soon as the gap is filled.
+   - every correctly received packet is acknowledged individually; the
+   acknum of an ACK is the sequence number of the packet it acknowledges.
+   - the window buffers are rings holding the packet at the window base
+   in a tracked slot, so any sequence space of at least 2 * windowsize
+   (--seqspace) works.
+   - the unacked packets are also linked in the order of their deadlines,
+   so the earliest is at hand without scanning the window.  A packet sent
+   or resent gets the latest deadline but for a shrinking timeout, so it
+   is linked in at or near the end.
+**********************************************************************/
+
+/* distance from base to seqnum going forward in the sequence space */
+static int seqoffset(struct sr *s, int base, int seqnum)
+{
+  return seqwrap(seqnum - base + s->seqspace, s->seqspace, s->seqmask);
+}
+
+/* the sequence space of a run: the min sequence space for SR is
+   2 * windowsize, which is also the default */
+static int srseqspace(const struct params *params)
+{
+  if (params->seqspace != 0)
+    return params->seqspace;
+  return 2 * params->windowsize;
+}
+
+/********* Sender (A) variables and functions ************/
+
+/* link the unacked packet in slot i into the deadline order, after the
+   packets whose deadlines are not later than its own */
+static void linkdeadline(struct sr *s, int i)
+{
+  struct srsend *p = &s->sndbuf[i];
+  int q = s->latest;
+
+  while (q >= 0 && s->sndbuf[q].deadline > p->deadline)
+    q = s->sndbuf[q].prev;
+  p->prev = q;
+  if (q >= 0) {
+    p->next = s->sndbuf[q].next;
+    s->sndbuf[q].next = i;
+  }
+  else {
+    p->next = s->earliest;
+    s->earliest = i;
+  }
+  if (p->next >= 0)
+    s->sndbuf[p->next].prev = i;
+  else
+    s->latest = i;
+}
+
+/* take the packet in slot i out of the deadline order */
+static void unlinkdeadline(struct sr *s, int i)
+{
+  struct srsend *p = &s->sndbuf[i];
+
+  if (p->prev >= 0)
+    s->sndbuf[p->prev].next = p->next;
+  else
+    s->earliest = p->next;
+  if (p->next >= 0)
+    s->sndbuf[p->next].prev = p->prev;
+  else
+    s->latest = p->prev;
+}
+
+/* earliest deadline of the unacked packets in the window, or -1 if every
+   packet has been acknowledged */
+static double earliestdeadline(struct sr *s)
+{
+  if (s->earliest < 0)
+    return -1.0;
+  return s->sndbuf[s->earliest].deadline;
+}
+
+/* arm the emulator timer for the earliest deadline of the unacked packets,
+   or stop it if every packet in the window has been acknowledged */
+static void armtimer(struct sr *s)
+{
+  double earliest = earliestdeadline(s);
+
+  if (earliest >= 0.0) {
+    restarttimer(s->emu, A, earliest - gettime(s->emu));
+    s->timerrunning = true;
+  }
+  else if (s->timerrunning) {
+    stoptimer(s->emu, A);
+    s->timerrunning = false;
+  }
+}
+
+/* send a message in the next free window slot.  It arrived from layer 5
+   at time arrival, and may have waited in the queue since */
+static void sendmessage(struct sr *s, const struct msg *message, double arrival)
+{
+  struct srsend *p;
+  int i;
+
+  /* create packet in its window slot */
+  i = (s->sendslot + s->windowcount) & s->bufmask;
+  p = &s->sndbuf[i];
+  p->packet = pktalloc(s->pool);
+  p->packet->seqnum = s->A_nextseqnum;
+  p->packet->acknum = NOTINUSE;
+  p->packet->length = message->length;
+  memcpy(p->packet->payload, message->data, message->length);
+  p->packet->checksum = ComputeChecksum(s->checksum, p->packet);
+  p->sent = gettime(s->emu);
+  p->deadline = p->sent + rtointerval(&s->rto);
+  p->resent = false;
+  p->acked = false;
+  linkdeadline(s, i);
+  s->windowcount++;
+  histadd(&s->stats->queuedelay, p->sent - arrival);
+
+  /* send out packet */
+  s->stats->packets_sent++;
+  TRACEF(1, "Sending packet %d to layer 3\n", p->packet->seqnum);
+  tolayer3(s->emu, A, p->packet);
+
+  /* start timer if it is not already running for an earlier packet */
+  if (!s->timerrunning) {
+    starttimer(s->emu, A, rtointerval(&s->rto));
+    s->timerrunning = true;
+  }
+
+  /* get next sequence number, wrap back to 0 */
+  s->A_nextseqnum = seqwrap(s->A_nextseqnum + 1, s->seqspace, s->seqmask);
+}
+
+/* called from layer 5 (application layer), passed the message to be sent to other side */
+void SR_A_output(struct sr *s, const struct msg *message)
+{
+  /* if not blocked waiting on ACK */
+  if (s->windowcount < s->windowsize) {
+    TRACEF(2, "----A: New message arrives, send window is not full, send new messge to layer3!\n");
+    sendmessage(s, message, gettime(s->emu));
+  }
+  /* if blocked, hold the message until the window slides */
+  else if (mqpush(&s->queue, message, gettime(s->emu))) {
+    TRACEF(1, "----A: New message arrives, send window is full, message queued\n");
+    s->stats->messages_queued++;
+  }
+  /* if blocked and the queue is full */
+  else {
+    TRACEF(1, "----A: New message arrives, send window is full\n");
+    s->stats->window_full++;
+  }
+}
+
+bool SR_A_ready(struct sr *s)
+{
+  return s->windowcount < s->windowsize;
+}
+
+/* send queued messages while there is room in the window */
+static void drainqueue(struct sr *s)
+{
+  const struct queued *item;
+
+  while (s->windowcount < s->windowsize && s->queue.count > 0) {
+    item = mqpop(&s->queue);
+    TRACEF(2, "----A: window has room, send queued message to layer3!\n");
+    sendmessage(s, &item->message, item->arrival);
+  }
+}
+
+/* called from layer 3, when a packet arrives for layer 4
+   In this practical this will always be an ACK as B never sends data.
+*/
+void SR_A_input(struct sr *s, struct pkt *packet)
+{
+  struct srsend *p;
+  int offset = s->windowcount;
+  int i;
+
+  /* if received ACK is not corrupted */
+  if (!IsCorrupted(s->checksum, packet)) {
+    TRACEF(1, "----A: uncorrupted ACK %d is received\n",packet->acknum);
+    s->stats->total_ACKs_received++;
+
+    /* check if the ACK is for an unacked packet in the window */
+    if (packet->acknum >= 0 && packet->acknum < s->seqspace)
+      offset = seqoffset(s, s->sendbase, packet->acknum);
+    i = (s->sendslot + offset) & s->bufmask;
+    if (offset < s->windowcount && !s->sndbuf[i].acked) {
+      TRACEF(1, "----A: ACK %d is not a duplicate\n",packet->acknum);
+      s->stats->new_ACKs++;
+      p = &s->sndbuf[i];
+      p->acked = true;
+      unlinkdeadline(s, i);
+      if (!p->resent)
+        rtosample(&s->rto, gettime(s->emu) - p->sent);
+      else
+        rtoresentacked(&s->rto, gettime(s->emu) - p->sent);
+
+      /* slide the window past every acknowledged packet at its base */
+      while (s->windowcount > 0) {
+        p = &s->sndbuf[s->sendslot];
+        if (!p->acked)
+          break;
+        pktrelease(s->pool, p->packet);
+        s->sendbase = seqwrap(s->sendbase + 1, s->seqspace, s->seqmask);
+        s->sendslot = (s->sendslot + 1) & s->bufmask;
+        s->windowcount--;
+      }
+
+      /* the earliest deadline may have changed */
+      armtimer(s);
+
+      /* the window may have room for queued messages again */
+      drainqueue(s);
+    }
+    else
+      TRACEF(1, "----A: duplicate ACK received, do nothing!\n");
+  }
+  else
+    TRACEF(1, "----A: corrupted ACK is received, do nothing!\n");
+}
+
+static int compareint(const void *a, const void *b)
+{
+  return *(const int *)a - *(const int *)b;
+}
+
+/* called when A's timer goes off */
+void SR_A_timerinterrupt(struct sr *s)
+{
+  struct srsend *p;
+  double now = gettime(s->emu);
+  double expired;
+  int i, k, n;
+
+  s->timerrunning = false;
+  TRACEF(1, "----A: time out,resend packets!\n");
+  rtoexpired(&s->rto);
+
+  /* the timer was armed for the earliest deadline, so that packet has
+     expired even if rounding of the clock leaves its deadline just ahead */
+  expired = earliestdeadline(s);
+  if (expired < now)
+    expired = now;
+
+  /* the expired packets are at the front of the deadline order.  They
+     are resent in sequence order, which a shrinking timeout can make
+     differ from the order of their deadlines */
+  n = 0;
+  for (i = s->earliest; i >= 0 && s->sndbuf[i].deadline <= expired; i = s->sndbuf[i].next)
+    s->resends[n++] = (i - s->sendslot) & s->bufmask;
+  qsort(s->resends, n, sizeof(int), compareint);
+
+  /* each is linked in again behind the packets still waiting */
+  for (k=0; k<n; k++) {
+    i = (s->sendslot + s->resends[k]) & s->bufmask;
+    p = &s->sndbuf[i];
+    unlinkdeadline(s, i);
+
+    TRACEF(1, "---A: resending packet %d\n", p->packet->seqnum);
+    tolayer3(s->emu, A, p->packet);
+    s->stats->packets_resent++;
+    p->sent = now;
+    p->deadline = now + rtointerval(&s->rto);
+    p->resent = true;
+    linkdeadline(s, i);
+  }
+  armtimer(s);
+}
+
+
+/* the following routine will be called once (only) before any other */
+/* entity A routines are called. You can use it to do any initialization */
+void SR_A_init(struct sr *s, struct emulator *emu)
+{
+  const struct params *params = getparams(emu);
+  struct srsend *grown;
+  int *resends;
+
+  s->emu = emu;
+  s->stats = getstats(emu);
+  s->pool = getpktpool(emu);
+  s->checksum = getchecksum(params->checksum);
+  s->windowsize = params->windowsize;
+  s->seqspace = srseqspace(params);
+  s->seqmask = seqmaskof(s->seqspace);
+  rtoinit(&s->rto, emu, true);
+
+  /* size the window buffer for the configured window, rounded up to a
+     power of two so that its indexes wrap with a mask */
+  s->bufmask = ringcapacity(s->windowsize) - 1;
+  grown = realloc(s->sndbuf, (s->bufmask + 1) * sizeof(struct srsend));
+  if (grown == NULL) {
+    printf("memory allocation for window buffer failed.");
+    exit(EXIT_FAILURE);
+  }
+  s->sndbuf = grown;
+  resends = realloc(s->resends, (s->bufmask + 1) * sizeof(int));
+  if (resends == NULL) {
+    printf("memory allocation for window buffer failed.");
+    exit(EXIT_FAILURE);
+  }
+  s->resends = resends;
+
+  s->A_nextseqnum = 0;  /* A starts with seq num 0, do not change this */
+  s->sendbase = 0;
+  s->sendslot = 0;
+  s->windowcount = 0;
+  s->earliest = s->latest = -1;
+  s->timerrunning = false;
+  mqinit(&s->queue, params->queuelimit);
+}
+
+
+
+/********* Receiver (B)  variables and procedures ************/
+
+/* called from layer 3, when a packet arrives for layer 4 at B*/
+void SR_B_input(struct sr *s, struct pkt *packet)
+{
+  struct pkt *sendpkt;
+  struct srrecv *slot;
+  int offset;
+
+  /* corrupted packets are dropped, the sender's timer recovers them */
+  if (IsCorrupted(s->checksum, packet) || packet->seqnum < 0 || packet->seqnum >= s->seqspace) {
+    TRACEF(1, "----B: packet corrupted, do nothing!\n");
+    return;
+  }
+
+  offset = seqoffset(s, s->rcvbase, packet->seqnum);
+  if (offset < s->windowsize) {
+    /* within the receive window: buffer it unless it is a duplicate */
+    slot = &s->rcvbuf[(s->rcvslot + offset) & s->bufmask];
+    if (!slot->received) {
+      TRACEF(1, "----B: packet %d is correctly received, send ACK!\n",packet->seqnum);
+      s->stats->packets_received++;
+      slot->packet = pkthold(packet);
+      slot->received = true;
+    }
+    else
+      TRACEF(1, "----B: duplicate packet %d is received, send ACK!\n",packet->seqnum);
+
+    /* deliver every in order packet at the base of the window */
+    for (;;) {
+      slot = &s->rcvbuf[s->rcvslot];
+      if (!slot->received)
+        break;
+      tolayer5(s->emu, B, slot->packet->payload, slot->packet->length);
+      pktrelease(s->pool, slot->packet);
+      slot->received = false;
+      s->rcvbase = seqwrap(s->rcvbase + 1, s->seqspace, s->seqmask);
+      s->rcvslot = (s->rcvslot + 1) & s->bufmask;
+    }
+  }
+  else if (offset >= s->seqspace - s->windowsize)
+    /* already delivered, the ACK must have been lost: acknowledge again */
+    TRACEF(1, "----B: packet %d was already received, resend ACK!\n",packet->seqnum);
+  else {
+    TRACEF(1, "----B: packet %d is outside the receive window, do nothing!\n",packet->seqnum);
+    return;
+  }
+
+  /* create packet acknowledging this sequence number */
+  sendpkt = makeack(s->pool, s->checksum, NOTINUSE, packet->seqnum);
+
+  /* send out packet, the emulator holds it from now on */
+  tolayer3(s->emu, B, sendpkt);
+  pktrelease(s->pool, sendpkt);
+}
+
+/* the following routine will be called once (only) before any other */
+/* entity B routines are called. You can use it to do any initialization */
+void SR_B_init(struct sr *s, struct emulator *emu)
+{
+  const struct params *params = getparams(emu);
+  struct srrecv *grown;
+  int i;
+
+  s->emu = emu;
+  s->stats = getstats(emu);
+  s->pool = getpktpool(emu);
+  s->checksum = getchecksum(params->checksum);
+  s->windowsize = params->windowsize;
+  s->seqspace = srseqspace(params);
+  s->seqmask = seqmaskof(s->seqspace);
+  s->bufmask = ringcapacity(s->windowsize) - 1;
+
+  grown = realloc(s->rcvbuf, (s->bufmask + 1) * sizeof(struct srrecv));
+  if (grown == NULL) {
+    printf("memory allocation for window buffer failed.");
+    exit(EXIT_FAILURE);
+  }
+  s->rcvbuf = grown;
+  for (i=0; i<=s->bufmask; i++)
+    s->rcvbuf[i].received = false;
+  s->rcvbase = 0;
+  s->rcvslot = 0;
+}
+
+/* release the window buffers, the connection can be initialised again */
+void freesr(struct sr *s)
+{
+  free(s->sndbuf);
+  free(s->rcvbuf);
+  free(s->resends);
+  s->sndbuf = NULL;
+  s->resends = NULL;
+  s->rcvbuf = NULL;
+  mqfree(&s->queue);
+}
@@ -0,0 +1,60 @@
+/* a packet in the Selective Repeat sender window */
+struct srsend {
+  struct pkt *packet;      /* reference to the packet in the pool */
+  double deadline;         /* time at which the packet's logical timer expires */
+  double sent;             /* time the packet was last sent */
+  bool resent;             /* retransmitted, so its round trip is ambiguous */
+  bool acked;              /* individually acknowledged by B */
+  int prev, next;          /* neighbours in the deadline order of the unacked
+                              packets, as sndbuf indexes, -1 at either end */
+};
+
+/* a slot in the Selective Repeat receiver window */
+struct srrecv {
+  struct pkt *packet;      /* reference to the packet, while received */
+  bool received;           /* holds an out of order packet not yet delivered */
+};
+
+/* state of one Selective Repeat connection: the sender at A and the receiver at B */
+struct sr {
+  struct emulator *emu;    /* the network this connection runs over */
+  struct stats *stats;     /* statistics of the current run */
+  struct pktpool *pool;    /* buffers of the packets */
+  const struct checksum *checksum;  /* packet checksum algorithm */
+  int windowsize;          /* the maximum number of buffered unacked packet */
+  int seqspace;            /* the sequence space, at least 2 * windowsize */
+  int seqmask;             /* seqspace - 1 if it is a power of two, otherwise 0 */
+  int bufmask;             /* window buffer capacity - 1, the capacity is a power of two */
+  struct rto rto;          /* retransmission timeout of the sender */
+
+  /* sender (A) */
+  struct srsend *sndbuf;   /* window ring, sendslot holds the packet at sendbase */
+  int sendbase;            /* sequence number of the oldest unacked packet */
+  int sendslot;            /* index in sndbuf of the packet at sendbase */
+  int windowcount;         /* the number of packets in the window */
+  int earliest, latest;    /* sndbuf indexes of the unacked packets with the earliest
+                              and latest deadlines, -1 if there are none */
+  int *resends;            /* window offsets of the packets a timeout resends */
+  int A_nextseqnum;        /* the next sequence number to be used by the sender */
+  bool timerrunning;       /* the emulator timer is armed for the earliest deadline */
+  struct msgqueue queue;   /* messages waiting for room in the window */
+
+  /* receiver (B) */
+  struct srrecv *rcvbuf;   /* window ring, rcvslot holds the packet at rcvbase */
+  int rcvbase;             /* the sequence number expected next by the receiver */
+  int rcvslot;             /* index in rcvbuf of the packet at rcvbase */
+};
+
+extern void SR_A_init(struct sr *, struct emulator *);
+extern void SR_B_init(struct sr *, struct emulator *);
+extern void SR_A_input(struct sr *, struct pkt *);
+extern void SR_B_input(struct sr *, struct pkt *);
+extern void SR_A_output(struct sr *, const struct msg *);
+extern void SR_A_timerinterrupt(struct sr *);
+
+/* true if A would send a message from layer 5 at once, rather than queue
+   or drop it; used by a saturating source */
+extern bool SR_A_ready(struct sr *);
+
+/* release the memory held by a connection */
+extern void freesr(struct sr *);
@@ -0,0 +1,129 @@
+#include <math.h>
+#include "steady.h"
+
+/* Batch means and MSER truncation, for stopping a run once its goodput
+   and latency are known precisely enough. */
+
+double tquantile(int df)
+{
+  static const double t95[30] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+  };
+
+  if (df <= 30)
+    return t95[df - 1];
+  return 1.96 + 2.372 / df;     /* Cornish-Fisher expansion around the normal */
+}
+
+void steadyinit(struct steady *s, double start)
+{
+  s->nbatches = 0;
+  s->batchsize = STEADYBATCH;
+  s->start = start;
+  s->current.count = 0;
+  s->current.latency = 0.0;
+}
+
+/* halve the number of batches by merging them in pairs */
+static void merge(struct steady *s)
+{
+  struct steadybatch *to, *a, *b;
+  int i;
+
+  for (i=0; i<s->nbatches/2; i++) {
+    to = &s->batches[i];
+    a = &s->batches[2*i];
+    b = &s->batches[2*i+1];
+    to->count = a->count + b->count;
+    to->latency = a->latency + b->latency;
+    to->end = b->end;
+  }
+  s->nbatches /= 2;
+  s->batchsize *= 2;
+}
+
+int steadyadd(struct steady *s, double time, double latency)
+{
+  s->current.count++;
+  s->current.latency += latency;
+  if (s->current.count < s->batchsize)
+    return 0;
+
+  s->current.end = time;
+  s->batches[s->nbatches++] = s->current;
+  s->current.count = 0;
+  s->current.latency = 0.0;
+  if (s->nbatches == STEADYBATCHES)
+    merge(s);
+  return 1;
+}
+
+/* MSER: the number of leading values of x to drop, at most half of them,
+   that minimises the squared standard error of the mean of the rest */
+static int mser(const double *x, int n)
+{
+  double sum = 0.0, sumsq = 0.0, m, best = -1.0, v;
+  int d, cut = 0;
+
+  for (d=n-1; d>=0; d--) {
+    sum += x[d];
+    sumsq += x[d] * x[d];
+    if (d > n / 2)
+      continue;
+    m = n - d;
+    v = fmax(0.0, sumsq - sum * sum / m) / (m * m);
+    if (best < 0.0 || v <= best) {
+      best = v;
+      cut = d;
+    }
+  }
+  return cut;
+}
+
+/* mean of x[0..n-1] and the half width of its 95% confidence interval */
+static double meanhalf(const double *x, int n, double *half)
+{
+  double sum = 0.0, sumsq = 0.0, mean;
+  int i;
+
+  for (i=0; i<n; i++) {
+    sum += x[i];
+    sumsq += x[i] * x[i];
+  }
+  mean = sum / n;
+  *half = tquantile(n - 1) * sqrt(fmax(0.0, (sumsq - n * mean * mean) / (n - 1))) / sqrt(n);
+  return mean;
+}
+
+void steadyestimate(const struct steady *s, struct steadyestimate *e)
+{
+  double latency[STEADYBATCHES], goodput[STEADYBATCHES];
+  double begin = s->start;
+  int i, d, n = s->nbatches;
+
+  for (i=0; i<n; i++) {
+    latency[i] = s->batches[i].latency / s->batches[i].count;
+    goodput[i] = s->batches[i].end > begin ? s->batches[i].count / (s->batches[i].end - begin) : 0.0;
+    begin = s->batches[i].end;
+  }
+  d = n > 0 ? mser(latency, n) : 0;
+  if (n > 0 && mser(goodput, n) > d)
+    d = mser(goodput, n);
+
+  e->warmupend = d > 0 ? s->batches[d-1].end : s->start;
+  e->batches = 0;
+  e->goodput = e->goodputhalf = e->latency = e->latencyhalf = 0.0;
+  if (n - d < STEADYMIN)
+    return;
+  e->batches = n - d;
+  e->goodput = meanhalf(goodput + d, n - d, &e->goodputhalf);
+  e->latency = meanhalf(latency + d, n - d, &e->latencyhalf);
+}
+
+int steadyconverged(const struct steadyestimate *e, double precision)
+{
+  return e->batches > 0 && e->goodputhalf <= precision * e->goodput &&
+         e->latencyhalf <= precision * e->latency;
+}
@@ -0,0 +1,50 @@
+/* steady state estimation of goodput and latency by the method of batch
+   means.  The messages delivered are grouped into batches of consecutive
+   deliveries; each batch yields its mean latency, and its goodput from
+   the time between the deliveries that end it and the batch before.  At
+   most STEADYBATCHES batches are kept, adjacent ones being merged in
+   pairs when they run out, so that the batches grow with the run and
+   their means become nearly independent.  The end of the warm-up is
+   found with MSER (White's Marginal Standard Error Rule) on the batch
+   means, and the batches before it are left out of the estimates. */
+
+#define  STEADYBATCH    32    /* messages in a batch at the start */
+#define  STEADYBATCHES  64    /* batches kept, a power of two */
+#define  STEADYMIN      10    /* batches after the warm-up needed for an estimate */
+
+struct steadybatch {
+  long count;              /* messages delivered */
+  double latency;          /* sum of their latencies */
+  double end;              /* time of the delivery that completed the batch */
+};
+
+struct steady {
+  struct steadybatch batches[STEADYBATCHES];
+  int nbatches;            /* batches completed */
+  int batchsize;           /* messages in a batch */
+  double start;            /* time the first batch starts */
+  struct steadybatch current;  /* the batch being filled */
+};
+
+/* the estimates, from the batches after the warm-up */
+struct steadyestimate {
+  double warmupend;        /* time the warm-up ends */
+  int batches;             /* batches after the warm-up, 0 if too few for an estimate */
+  double goodput;          /* mean goodput and the half width of its 95% confidence interval */
+  double goodputhalf;
+  double latency;          /* mean latency and the half width of its 95% confidence interval */
+  double latencyhalf;
+};
+
+/* two sided 95% quantile of Student's t distribution with df degrees of freedom */
+extern double tquantile(int);
+
+extern void steadyinit(struct steady *, double);
+
+/* a message delivered at time with latency; nonzero if it completed a batch */
+extern int steadyadd(struct steady *, double, double);
+
+extern void steadyestimate(const struct steady *, struct steadyestimate *);
+
+/* nonzero if both confidence intervals are within precision of their means */
+extern int steadyconverged(const struct steadyestimate *, double);
@@ -0,0 +1,27 @@
+/* Trace output.  Every trace statement names the lowest TRACE level at
+   which it is printed.  Levels above TRACE_MAX are removed at compile
+   time, so a benchmark build with -DTRACE_MAX=0 carries no trace checks
+   at all on the hot paths.  Trace lines are written to tracefile, which
+   is fully buffered (see traceinit) rather than flushed line by line. */
+
+#include <stdio.h>
+
+#ifndef TRACE_MAX
+#define TRACE_MAX 4     /* highest TRACE level compiled in */
+#endif
+
+extern FILE *tracefile;     /* where trace output goes, stdout by default */
+
+/* true if trace statements of this level are compiled in and enabled */
+#define TRACING(level)  ((level) <= TRACE_MAX && TRACE >= (level))
+
+/* print to the trace sink if TRACE is at least level */
+#define TRACEF(level, ...)                      \
+  do {                                          \
+    if (TRACING(level))                         \
+      fprintf(tracefile, __VA_ARGS__);          \
+  } while (0)
+
+/* set up the trace sink, path NULL selects stdout */
+extern void traceinit(const char *path);
+extern void traceclose(void);